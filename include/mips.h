@@ -7,5 +7,14 @@
 #include "mips_mem.h"
 #include "mips_cpu.h"
 #include "mips_test.h"
+#include "mips_replay.h"
+#include "mips_isa.h"
+#include "mips_pool.h"
+#include "mips_coverage.h"
+#include "mips_smp.h"
+#include "mips_sched.h"
+#include "mips_devices.h"
+#include "mips_aot.h"
+#include "mips_hle.h"
 
 #endif
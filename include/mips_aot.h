@@ -0,0 +1,214 @@
+/*! \file mips_aot.h
+    Loads and runs programs which have been translated ahead of time
+    into host code, either by tools/mips_aot or on demand through a cache.
+*/
+#ifndef mips_aot_header
+#define mips_aot_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_aot Ahead-of-time Translation
+
+    A program that is run millions of times spends nearly all of its
+    time fetching and decoding the same few instructions. tools/mips_aot
+    instead reads a binary image once, finds the basic blocks, and writes
+    out C++ with one piece of straight-line code per block, which the
+    host compiler turns into a shared library:
+
+        tools/mips_aot -o fib.aot.cpp fragments/f_fibonacci-mips.bin
+        g++ -O2 -shared -fPIC -I include -o fib.aot.so fib.aot.cpp
+
+    (or just "make fragments/f_fibonacci-mips.aot.so"). The library
+    can then be used in place of stepping the CPU:
+
+        mips_aot_h aot=mips_aot_open("fib.aot.so");
+        if(mips_aot_check(aot, mem)==mips_Success){
+            err=mips_aot_run(aot, cpu, mem, haltPc, 0, &steps);
+        }
+
+    Alternatively \ref mips_aot_cache_load does all of that at run time,
+    keeping the library in a directory so it is only built the first
+    time a given image is run:
+
+        mips_aot_h aot=mips_aot_cache_load("/tmp/aot", NULL, mem, base, length);
+
+    The translated code keeps the registers in locals, and copies them
+    to and from the CPU with the usual mips_cpu_* functions whenever it
+    starts or stops, so the CPU is always left as if it had been stepped
+    there. All memory accesses go through \ref mips_mem_read and
+    \ref mips_mem_write, so errors are the same as for the CPU.
+
+    Anything the translation can't handle is passed back to the CPU,
+    which is stepped until it reaches the start of a known block again.
+    That covers jumps to addresses outside the image (or which are not
+    the start of a block), invalid instructions, and every instruction
+    using HI and LO, as those can't be copied in and out of a CPU.
+
+    Limitations:
+    - The program must not write to its own code, as the translation
+      is of the image as it was when translated. \ref mips_aot_check
+      makes sure the image in memory is the one that was translated,
+      but the code isn't checked again while running.
+    - The step limit is only checked at the start of each block, so a
+      run can go a few instructions over it. The halt pc is checked
+      before every instruction, so runs stop exactly where stepping
+      the CPU would.
+    - If an instruction in a branch delay slot fails, the CPU is left
+      with its pc at the delay slot, but the branch is lost.
+
+    \addtogroup mips_aot
+    @{
+*/
+
+/*! Version of \ref mips_aot_module and of the code generated for it.
+    Libraries from a different version are rejected. */
+#define MIPS_AOT_VERSION 3
+
+/*! Name of the \ref mips_aot_module exported by a translated library. */
+#define MIPS_AOT_SYMBOL "mips_aot_exports"
+
+/*! Functions the translated code uses to get at the CPU and memory.
+    These are passed in, rather than being linked against, so that a
+    library works with whichever CPU the program loading it has. */
+typedef struct mips_aot_env
+{
+    mips_error (*cpu_get_register)(mips_cpu_h state, unsigned index, uint32_t *value);
+    mips_error (*cpu_set_register)(mips_cpu_h state, unsigned index, uint32_t value);
+    mips_error (*cpu_get_pc)(mips_cpu_h state, uint32_t *pc);
+    mips_error (*cpu_set_pc)(mips_cpu_h state, uint32_t pc);
+    mips_error (*mem_read)(mips_mem_h mem, uint32_t address, uint32_t length, uint8_t *dataOut);
+    mips_error (*mem_write)(mips_mem_h mem, uint32_t address, uint32_t length, const uint8_t *dataIn);
+} mips_aot_env;
+
+/*! What a translated library exports, under the name \ref MIPS_AOT_SYMBOL. */
+typedef struct mips_aot_module
+{
+    uint32_t version;   //!< MIPS_AOT_VERSION when the library was generated
+    uint32_t base;      //!< Address the image was translated at
+    uint32_t length;    //!< Length of the image in bytes
+    uint64_t hash;      //!< \ref mips_aot_hash of the image
+
+    /*! Runs translated code from the pc of the CPU, until it reaches
+        haltPc, runs maxSteps (if non-zero) instructions in total, hits
+        an error, or needs the CPU to step an instruction for it, in
+        which case *interpret is set. steps is the running total. */
+    mips_error (*run)(const mips_aot_env *env, mips_cpu_h cpu, mips_mem_h mem,
+        uint32_t haltPc, uint64_t maxSteps, uint64_t *steps, int *interpret);
+
+    /*! Returns non-zero if the given pc is the start of a translated block. */
+    int (*known)(uint32_t pc);
+} mips_aot_module;
+
+/*! Represents a loaded library. \struct mips_aot_impl */
+struct mips_aot_impl;
+
+/*! An opaque handle to a loaded library. See \ref mips_mem_h for more commentary. */
+typedef struct mips_aot_impl *mips_aot_h;
+
+/*! Hash used to tell whether the image in memory is the one that
+    was translated (64-bit FNV-1a). */
+uint64_t mips_aot_hash(const uint8_t *data, uint32_t length);
+
+/*! Loads a translated library.
+
+    Returns an empty handle if the library can't be loaded, doesn't
+    export \ref MIPS_AOT_SYMBOL, or is from a different version. Loading
+    libraries is only supported on systems with dlopen.
+*/
+mips_aot_h mips_aot_open(const char *path);
+
+/*! Checks that memory holds the image the library was translated from.
+
+    Returns mips_ErrorInvalidArgument if it doesn't, or the error from
+    reading the memory.
+*/
+mips_error mips_aot_check(mips_aot_h aot, mips_mem_h mem);
+
+/*! Runs the CPU from its current pc, using translated code wherever it
+    can, in the same way as calling \ref mips_cpu_step until the pc
+    reaches haltPc.
+
+    \param maxSteps Limit on the number of instructions, or zero for none.
+    \param steps Receives the number of instructions completed.
+
+    Returns mips_Success if the halt pc or the step limit was reached,
+    or else the error from the instruction that failed, with the CPU
+    at that instruction.
+*/
+mips_error mips_aot_run(
+    mips_aot_h aot,
+    mips_cpu_h cpu,
+    mips_mem_h mem,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    uint64_t *steps
+);
+
+/*! Returns the address and length of the translated image. */
+void mips_aot_get_image(mips_aot_h aot, uint32_t *base, uint32_t *length);
+
+/*! Writes the C++ translation of an image to dst, as done by tools/mips_aot.
+
+    \param sourceName Where the image came from, which only goes in a comment.
+    \param base Address the image is loaded at, which must be word aligned.
+    \param data The image. If length isn't a multiple of four it is
+        padded with zeros.
+    \param entries Addresses execution may start at, as well as base.
+
+    Returns mips_ErrorFileWriteError if writing failed.
+*/
+mips_error mips_aot_translate(
+    FILE *dst,
+    const char *sourceName,
+    uint32_t base,
+    const uint8_t *data,
+    uint32_t length,
+    unsigned entryCount,
+    const uint32_t *entries
+);
+
+/*! Command used by \ref mips_aot_cache_load to build libraries, unless
+    it is given another. It is run from the current directory, followed
+    by "-o library.so source.cpp". */
+#define MIPS_AOT_DEFAULT_COMPILER "c++ -O2 -shared -fPIC -I include"
+
+/*! Loads the translation of the image at [base, base+length) in memory,
+    translating it first if this image has never been seen before.
+
+    Translated libraries are kept in dir, named after the hash of the
+    image and its address, so the cost of translating and compiling is
+    only paid once for each image, and later runs (even from other
+    processes) start straight away with translated code. A library is
+    only used if its hash matches the memory, and one that is missing,
+    doesn't load, or doesn't match is built again. That only guards
+    against stale or corrupt entries: loading a library runs its code,
+    so the directory must not be writable by anyone untrusted.
+    Libraries are written under a temporary name and then renamed, so
+    several processes or threads can share a directory.
+
+    Returns an empty handle if the library could not be built or loaded.
+*/
+mips_aot_h mips_aot_cache_load(
+    const char *dir,        //!< Existing directory to keep libraries in
+    const char *compiler,   //!< Compile command, or NULL for \ref MIPS_AOT_DEFAULT_COMPILER
+    mips_mem_h mem,         //!< Memory holding the image
+    uint32_t base,          //!< Address of the image, which must be word aligned
+    uint32_t length         //!< Length of the image in bytes
+);
+
+/*! Unloads the library. Passing an empty handle is legal. */
+void mips_aot_close(mips_aot_h aot);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/*! \file mips_coverage.h
+    Records which instructions, encodings, register fields and exceptions
+    a program or test suite actually exercised.
+*/
+#ifndef mips_coverage_header
+#define mips_coverage_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_coverage Coverage
+
+    Passing a test suite says little if half the instructions were
+    never run, or if no test ever made ADD overflow. A coverage map is
+    a fixed-size bitmap with one bit for each of:
+
+    - each instruction in \ref mips_isa, combined with how the step
+      ended (success, or each kind of exception);
+    - each primary opcode, SPECIAL funct code and REGIMM rt code, so that
+      encodings outside the described instructions show up too;
+    - each value of the rs, rt, and rd fields, per instruction;
+    - optionally, each word address in a range of guest pcs.
+
+    Recording a step only sets bits, so the cost is a table lookup and
+    a few bit-sets, and maps can be combined with a bitwise OR. That
+    makes it simple to give each thread its own map and merge them at
+    the end, or to accumulate coverage over many runs in a file:
+
+        mips_coverage_h cov=mips_coverage_create(0, 0);
+        mips_coverage_load(cov, "coverage.bin");     // Merge any earlier runs
+
+        while(...){
+            err=mips_coverage_step(cov, cpu, mem);
+        }
+
+        mips_coverage_save(cov, "coverage.bin");
+        mips_coverage_report(cov, stderr);
+
+    \ref mips_coverage_step works with any CPU, as it fetches the
+    instruction itself before stepping. A CPU which is already decoding
+    the instruction can instead call \ref mips_coverage_record from
+    inside mips_cpu_step, which avoids the extra memory read.
+
+    \addtogroup mips_coverage
+    @{
+*/
+
+/*! Represents a coverage map. \struct mips_coverage_impl */
+struct mips_coverage_impl;
+
+/*! An opaque handle to a coverage map. See \ref mips_mem_h for more commentary. */
+typedef struct mips_coverage_impl *mips_coverage_h;
+
+/*! Creates an empty coverage map.
+
+    If pcLength is non-zero then the map also records which word
+    addresses in [pcBase, pcBase+pcLength) were executed. Pcs outside
+    that range are ignored.
+*/
+mips_coverage_h mips_coverage_create(
+    uint32_t pcBase,    //!< First byte address to track
+    uint32_t pcLength   //!< Number of bytes to track, or zero for none
+);
+
+/*! Records one executed instruction.
+
+    \param pc Address the instruction was fetched from
+    \param instruction The 32-bit encoding
+    \param err What mips_cpu_step returned for it
+*/
+void mips_coverage_record(mips_coverage_h cov, uint32_t pc, uint32_t instruction, mips_error err);
+
+/*! Fetches the instruction at the pc of the CPU, calls mips_cpu_step,
+    records the result, and returns it.
+
+    If the instruction can't be fetched, the step is still made, and
+    only the outcome is recorded against an unknown instruction.
+*/
+mips_error mips_coverage_step(mips_coverage_h cov, mips_cpu_h cpu, mips_mem_h mem);
+
+/*! Adds everything in src to dst. The pc ranges must be the same.
+    Returns mips_ErrorInvalidArgument if they are not.
+*/
+mips_error mips_coverage_merge(mips_coverage_h dst, mips_coverage_h src);
+
+/*! Clears every bit. */
+void mips_coverage_clear(mips_coverage_h cov);
+
+/*! Writes the map to a file, replacing it. */
+mips_error mips_coverage_save(mips_coverage_h cov, const char *path);
+
+/*! Merges a map previously written by \ref mips_coverage_save into cov.
+
+    A file that doesn't exist is treated as empty, so a first run
+    doesn't need to be special. Returns mips_ErrorFileReadError if
+    the file isn't a coverage map with the same pc range.
+*/
+mips_error mips_coverage_load(mips_coverage_h cov, const char *path);
+
+/*! Prints a table with one row per instruction, giving how the
+    instruction ended and how many of the possible values of each
+    register field were seen. Encodings which aren't described
+    instructions are listed after the table, then pc coverage if
+    it is being tracked.
+*/
+void mips_coverage_report(mips_coverage_h cov, FILE *dst);
+
+/*! Releases the map. Passing an empty handle is legal. */
+void mips_coverage_free(mips_coverage_h cov);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*! \file mips_devices.h
+    Memory-mapped devices which give guest programs a way to print
+    output and measure time.
+*/
+#ifndef mips_devices_header
+#define mips_devices_header
+
+#include "mips_mem.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_devices Console and Timer Devices
+
+    These are attached to a RAM (or a core view) with
+    \ref mips_mem_map_device, so they appear at fixed addresses
+    above the end of RAM. The suggested addresses are in the last
+    256 bytes of the address space, as those can be reached with a
+    negative offset from $zero, without needing a register set up:
+
+        addiu $t0, $zero, 'A'
+        sb    $t0, -256($zero)      # Print "A"
+        lw    $t1, -248($zero)      # Low word of instructions retired
+
+    Devices have side effects and give answers from outside the
+    program, so a memory with devices mapped can't be recorded with
+    \ref mips_replay.
+
+    \addtogroup mips_devices
+    @{
+*/
+
+/*! Suggested address for the console. */
+#define MIPS_CONSOLE_ADDRESS 0xFFFFFF00u
+
+/*! Suggested address for the timer, which is 8 bytes long. */
+#define MIPS_TIMER_ADDRESS 0xFFFFFF04u
+
+/*! Represents an output console. \struct mips_console_impl */
+struct mips_console_impl;
+
+/*! An opaque handle to a console. See \ref mips_mem_h for more commentary. */
+typedef struct mips_console_impl *mips_console_h;
+
+/*! Creates a console which writes to the given file.
+
+    The console is a single word register. Each write to it (of any
+    size) outputs one character, which is the least significant byte
+    written, and reads return zero.
+
+    Characters are collected in a buffer, which is only written to dst
+    when it is full, on a newline if lineBuffered is set, and by
+    \ref mips_console_flush or \ref mips_console_free. So a guest that
+    prints one byte at a time still results in a few large writes.
+
+    The console can be mapped into several memories at once, for
+    instance so that every core in a multi-core system shares it, and
+    it can be written from several threads.
+*/
+mips_console_h mips_console_create(
+    FILE *dst,              //!< Where the output goes
+    uint32_t bufferSize,    //!< Number of characters to collect before writing, or 0 for a default
+    int lineBuffered        //!< Non-zero to also write out at each newline
+);
+
+/*! Maps the console into a memory at the given address. */
+mips_error mips_console_attach(mips_console_h con, mips_mem_h mem, uint32_t address);
+
+/*! Writes out anything in the buffer. */
+void mips_console_flush(mips_console_h con);
+
+/*! Flushes and then releases the console. It must not be freed while
+    it is still mapped into a memory that is in use. Passing an empty
+    handle is legal.
+*/
+void mips_console_free(mips_console_h con);
+
+/*! Represents a timer. \struct mips_timer_impl */
+struct mips_timer_impl;
+
+/*! An opaque handle to a timer. See \ref mips_mem_h for more commentary. */
+typedef struct mips_timer_impl *mips_timer_h;
+
+/*! Creates a timer which counts instructions.
+
+    The timer doesn't look at the host clock at all, as that would cost
+    a system call per read and make runs non-deterministic. Instead it
+    reads the count of retired instructions from the given variable,
+    which whatever is calling mips_cpu_step keeps up to date.
+
+    The timer is two read-only words: the upper 32 bits of the count,
+    then the lower 32 bits. Writing to either gives
+    mips_ExceptionAccessViolation. The upper word of a 64-bit count
+    can change between two reads, so the usual way of reading it is:
+
+        do{ hi=timer[0]; lo=timer[1]; }while(hi!=timer[0]);
+*/
+mips_timer_h mips_timer_create(
+    const uint64_t *retired     //!< Number of instructions retired so far
+);
+
+/*! Maps the timer into a memory at the given address. */
+mips_error mips_timer_attach(mips_timer_h timer, mips_mem_h mem, uint32_t address);
+
+/*! Releases the timer. It must not be freed while it is still mapped
+    into a memory that is in use. Passing an empty handle is legal. */
+void mips_timer_free(mips_timer_h timer);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*! \file mips_hle.h
+    Runs some guest functions natively on the host, rather than
+    stepping through their instructions.
+*/
+#ifndef mips_hle_header
+#define mips_hle_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_hle High-level Emulation
+
+    Programs often spend most of their time in a few well-known
+    functions, such as memcpy or memset, whose behaviour is already
+    known exactly. High-level emulation replaces each call to one of
+    them with a host function: when the pc reaches the entry address of
+    a hooked function, the hook reads the arguments from the CPU, does
+    the work directly on the memory, sets the results, and the CPU
+    carries on from $ra as if the guest function had returned.
+
+    Hooks follow the o32 calling convention: the first four arguments
+    are in $a0-$a3, later ones are on the stack from 16($sp), and
+    results go in $v0 and $v1. \ref mips_hle_get_arg and
+    \ref mips_hle_set_result do this for them. Hooks should only touch
+    the registers a real call could have changed.
+
+    Each call counts as a number of instructions, given when the hook is
+    added and changeable by the hook itself, so that step limits, the
+    timer, and instruction counts still mean roughly what they would
+    without the hook, even though the call takes almost no time.
+
+    Limitations:
+    - The address must only be reached by calling it. A hooked address
+      that is also a branch target inside another function, or is
+      reached in a branch delay slot, will go wrong.
+    - If a hook fails part way through, any memory it already wrote
+      stays written, while the CPU is left at the entry address.
+
+    \addtogroup mips_hle
+    @{
+*/
+
+/*! Represents a set of hooks. \struct mips_hle_impl */
+struct mips_hle_impl;
+
+/*! An opaque handle to a set of hooks. See \ref mips_mem_h for more commentary. */
+typedef struct mips_hle_impl *mips_hle_h;
+
+/*! Called in place of the guest function at a hooked address.
+
+    steps starts off as the count given to \ref mips_hle_add, and can
+    be changed to reflect how much work the call did (for example,
+    a number of instructions per byte copied).
+
+    Returns mips_Success, or an error, in which case the CPU stays at
+    the hooked address and the error is returned as if from
+    \ref mips_cpu_step.
+*/
+typedef mips_error (*mips_hle_fn)(
+    void *param,        //!< The value given to \ref mips_hle_add
+    mips_cpu_h cpu,     //!< CPU making the call
+    mips_mem_h mem,     //!< Memory the CPU is attached to
+    uint64_t *steps     //!< Number of instructions the call counts as
+);
+
+/*! Creates an empty set of hooks. */
+mips_hle_h mips_hle_create();
+
+/*! Hooks the function at the given address, replacing any existing hook there.
+
+    Returns mips_ErrorInvalidArgument if the address isn't word aligned.
+*/
+mips_error mips_hle_add(
+    mips_hle_h hle,
+    uint32_t address,   //!< Entry address of the guest function
+    mips_hle_fn fn,     //!< Host function to run instead
+    void *param,        //!< Passed to fn
+    uint64_t steps      //!< Instructions each call counts as, unless fn changes it
+);
+
+/*! Returns non-zero if there is a hook at the given address. */
+int mips_hle_is_hooked(mips_hle_h hle, uint32_t address);
+
+/*! Does the same as \ref mips_cpu_step, except that if the pc is at
+    a hooked address the hook is called instead, and the CPU is moved
+    on to $ra.
+
+    \param steps Receives the number of instructions that counts as,
+        which is 1 unless a hook was called. Can be NULL.
+*/
+mips_error mips_hle_step(mips_hle_h hle, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps);
+
+/*! Runs the CPU from its current pc, calling hooks where they apply,
+    until the pc reaches haltPc.
+
+    \param maxSteps Limit on the number of instructions, or zero for
+        none. A hook can take the count over the limit.
+    \param steps Receives the number of instructions completed,
+        including those counted for hooks.
+
+    Returns mips_Success if the halt pc or the step limit was reached,
+    or else the error from the instruction or hook that failed.
+*/
+mips_error mips_hle_run(
+    mips_hle_h hle,
+    mips_cpu_h cpu,
+    mips_mem_h mem,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    uint64_t *steps
+);
+
+/*! Reads argument number index (from 0) of the current call, from
+    $a0-$a3 or from the stack. */
+mips_error mips_hle_get_arg(mips_cpu_h cpu, mips_mem_h mem, unsigned index, uint32_t *value);
+
+/*! Sets the result of the current call in $v0 and $v1. */
+mips_error mips_hle_set_result(mips_cpu_h cpu, uint32_t v0, uint32_t v1);
+
+/*! Hook for memcpy(dst, src, n), which returns dst.
+
+    param is either NULL, or points to a uint32_t giving the number of
+    instructions each word (or part word) copied counts as. These are
+    added to the fixed count given to \ref mips_hle_add, so a call
+    copying n bytes counts as steps+rate*((n+3)/4). For a typical word
+    loop (load, store, two increments and a branch) the rate is 5.
+*/
+mips_error mips_hle_memcpy(void *param, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps);
+
+/*! Hook for memset(dst, c, n), which returns dst. param is as for
+    \ref mips_hle_memcpy. */
+mips_error mips_hle_memset(void *param, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps);
+
+/*! Releases the hooks. Passing an empty handle is legal. */
+void mips_hle_free(mips_hle_h hle);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,93 @@
+/*! \file mips_isa.h
+    A machine readable description of the instructions covered by this
+    simulator, for tools which need to generate or recognise instructions
+    without executing them.
+*/
+#ifndef mips_isa_header
+#define mips_isa_header
+
+#include "mips_core.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_isa Instruction Set Description
+
+    This is not a CPU: it doesn't say what an instruction does, only
+    how it is encoded and what broad kind of thing it does. That is
+    enough for tools like test generators, profilers, and checkpointing
+    code to work out what they are looking at, without each of them
+    containing their own copy of the opcode tables.
+
+    An encoding belongs to an instruction if:
+
+        (encoding & info->mask) == info->match
+
+    The remaining bits are operand fields, and info->operands says
+    which of those fields the instruction actually uses. Fields
+    which are not used should be zero in a valid encoding.
+
+    \addtogroup mips_isa
+    @{
+*/
+
+/*! Bit masks of the operand fields within an encoding. */
+///@{
+#define MIPS_ISA_RS         0x03E00000u
+#define MIPS_ISA_RT         0x001F0000u
+#define MIPS_ISA_RD         0x0000F800u
+#define MIPS_ISA_SHAMT      0x000007C0u
+#define MIPS_ISA_IMMEDIATE  0x0000FFFFu
+#define MIPS_ISA_TARGET     0x03FFFFFFu
+///@}
+
+/*! Properties of an instruction, which can be combined. */
+typedef enum _mips_isa_flags{
+    mips_isa_Branch=0x1,        //!< Conditional PC-relative branch, with a delay slot
+    mips_isa_Jump=0x2,          //!< Unconditional jump, with a delay slot
+    mips_isa_Link=0x4,          //!< Writes a return address to a register
+    mips_isa_Load=0x8,          //!< Reads from memory
+    mips_isa_Store=0x10,        //!< Writes to memory
+    mips_isa_WritesHiLo=0x20,   //!< Writes HI and/or LO
+    mips_isa_ReadsHiLo=0x40,    //!< Reads HI or LO
+    mips_isa_Overflow=0x80      //!< Can raise mips_ExceptionArithmeticOverflow
+}mips_isa_flags;
+
+/*! Description of one instruction. */
+typedef struct _mips_isa_info{
+    const char *name;   //!< Upper case mnemonic, as used by \ref mips_test_begin_test
+    uint32_t match;     //!< Value of the identifying bits
+    uint32_t mask;      //!< Which bits identify the instruction
+    uint32_t operands;  //!< Union of the MIPS_ISA_* fields that are used
+    unsigned flags;     //!< Combination of \ref mips_isa_flags
+    unsigned length;    //!< Bytes transferred, for loads and stores
+}mips_isa_info;
+
+/*! Number of instructions described. They are numbered 0 to
+    mips_isa_count()-1, in alphabetical order of name. */
+unsigned mips_isa_count();
+
+/*! Returns the description of an instruction, or NULL if the
+    index is out of range. */
+const mips_isa_info *mips_isa_get(unsigned index);
+
+/*! Works out which instruction an encoding is.
+
+    \retval Index of the instruction, or -1 if the encoding is not one
+    of the described instructions.
+
+    Only the identifying bits are looked at, so an encoding with
+    non-zero unused fields is still recognised.
+*/
+int mips_isa_decode(uint32_t encoding);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
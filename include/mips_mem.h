@@ -181,11 +181,156 @@ void mips_mem_free(mips_mem_h mem);
     "byte-enables". These are what allows a CPU to indicate
     which of the bytes within a 32-bit bus are being actively
     written.
+    
+    The contents of a new RAM are all zero.
 */
 mips_mem_h mips_mem_create_ram(
     uint32_t cbMem	//!< Total number of bytes of ram
 );
 
+/*! Granularity at which a RAM keeps track of which parts of it
+    have been written to.
+    
+    Every successful \ref mips_mem_write marks the page containing
+    the address as "dirty". Tools which need to save and restore
+    the contents of a RAM (for example to take checkpoints) can then
+    copy only the pages that actually changed, rather than the whole
+    RAM. Transactions are at most 4 bytes and must be aligned, so a
+    single transaction never touches more than one page.
+*/
+#define MIPS_MEM_RAM_PAGE_SIZE 4096u
+
+/*! Returns the size in bytes of a RAM created with \ref mips_mem_create_ram. */
+mips_error mips_mem_ram_get_size(
+    mips_mem_h mem,     //!< Handle to a RAM
+    uint32_t *cbMem     //!< Receives the total number of bytes of ram
+);
+
+/*! Lists the pages which have been written since the dirty set
+    was last cleared (or since the RAM was created).
+    
+    The indices of up to maxPages dirty pages are written to pages,
+    and the total number of dirty pages is written to count, so
+    the number of pages can be found first by passing maxPages=0:
+    
+        uint32_t n;
+        mips_mem_ram_get_dirty_pages(mem, 0, NULL, &n);
+        std::vector<uint32_t> pages(n);
+        mips_mem_ram_get_dirty_pages(mem, n, &pages[0], &n);
+    
+    The cost is proportional to the number of dirty pages, not to
+    the size of the RAM.
+*/
+mips_error mips_mem_ram_get_dirty_pages(
+    mips_mem_h mem,     //!< Handle to a RAM
+    uint32_t maxPages,  //!< Number of entries available in pages
+    uint32_t *pages,    //!< Receives page indices (can be NULL if maxPages==0)
+    uint32_t *count     //!< Receives the total number of dirty pages
+);
+
+/*! Marks every page of the RAM as clean again. */
+mips_error mips_mem_ram_clear_dirty(mips_mem_h mem);
+
+/*! Puts the RAM back into the state it was created in: every byte
+    is zero, and no pages are dirty.
+    
+    The RAM separately remembers every page written since it was created
+    or last reset, whatever happened to the dirty set, so the cost is
+    proportional to the number of pages written, not the size of the RAM.
+    Large RAMs which have had a lot written to them may be handed back
+    to the operating system in one go instead.
+*/
+mips_error mips_mem_ram_reset(mips_mem_h mem);
+
+/*! Copies one page out of the RAM, without the alignment and length
+    restrictions of \ref mips_mem_read.
+    
+    The buffer must have room for \ref MIPS_MEM_RAM_PAGE_SIZE bytes. If
+    the size of the RAM is not a multiple of the page size then
+    only the bytes that exist are copied from the last page.
+*/
+mips_error mips_mem_ram_read_page(
+    mips_mem_h mem,     //!< Handle to a RAM
+    uint32_t page,      //!< Index of the page (address / MIPS_MEM_RAM_PAGE_SIZE)
+    uint8_t *dataOut    //!< Receives the contents of the page
+);
+
+/*! Overwrites one page of the RAM. This counts as a write, so the
+    page will be marked as dirty.
+*/
+mips_error mips_mem_ram_write_page(
+    mips_mem_h mem,     //!< Handle to a RAM
+    uint32_t page,      //!< Index of the page (address / MIPS_MEM_RAM_PAGE_SIZE)
+    const uint8_t *dataIn   //!< New contents of the page
+);
+
+/*! Creates a view of an existing RAM for one core of a multi-core
+    system (see \ref mips_smp).
+
+    Every transaction on the view goes to the RAM, except that reads
+    of the word at idAddress return coreId, so software running on
+    several cores can find out which one it is on. Byte and half-word
+    reads get the matching part of the big-endian word, in the same
+    way as for RAM. Writing any part of the word gives
+    mips_ExceptionAccessViolation. The address can be inside the
+    RAM, in which case that word is hidden from the core, or outside it.
+
+    The mips_mem_ram_* functions act on the underlying RAM when given
+    a view. Freeing a view doesn't affect the RAM, but the RAM must not
+    be freed while any of its views are still in use.
+
+    Returns an empty handle if ram is empty or idAddress is not aligned.
+*/
+mips_mem_h mips_mem_create_core_view(
+    mips_mem_h ram,     //!< Handle to a RAM created with \ref mips_mem_create_ram
+    uint32_t coreId,    //!< Value the core reads back
+    uint32_t idAddress  //!< Word address the core reads it from
+);
+
+/*! Handles the transactions to a device mapped with \ref mips_mem_map_device.
+
+    The length and alignment have already been checked, and the whole
+    transaction is inside the device. The bytes are in the same order
+    as for \ref mips_mem_read and \ref mips_mem_write, so the most
+    significant byte of a word is data[0]. On a read the device must
+    fill in all of data.
+
+    Returns mips_Success, or the exception the CPU should take (for
+    example mips_ExceptionAccessViolation for a read-only register).
+*/
+typedef mips_error (*mips_mem_device_fn)(
+    void *param,        //!< The value given to \ref mips_mem_map_device
+    int write,          //!< Non-zero for a write
+    uint32_t offset,    //!< Address relative to the start of the device
+    uint32_t length,    //!< 1, 2 or 4 bytes
+    uint8_t *data       //!< Bytes written, or receives the bytes read
+);
+
+/*! Maps a device (such as those in \ref mips_devices) into the
+    address space of a RAM or a core view, so that transactions to
+    [base, base+length) are passed to fn instead of failing.
+
+    Devices have to be above the end of the RAM, which means accesses
+    to the RAM never need to look for them. A device mapped on a core
+    view is only seen by that core, while one mapped on the RAM is seen
+    by every core. Devices can't be removed, and should be mapped before
+    any CPU is running.
+
+    Returns mips_ErrorInvalidArgument if the range isn't word aligned,
+    overlaps the RAM, or overlaps another device on the same handle.
+*/
+mips_error mips_mem_map_device(
+    mips_mem_h mem,     //!< Handle to a RAM or core view
+    uint32_t base,      //!< First address of the device
+    uint32_t length,    //!< Number of bytes the device covers
+    mips_mem_device_fn fn,  //!< Handles transactions to the device
+    void *param         //!< Passed to fn
+);
+
+/*! Returns non-zero if any device is mapped on the handle, or, for a
+    core view, on the RAM it is a view of. */
+int mips_mem_has_devices(mips_mem_h mem);
+
 /*!
     @}
     @}
@@ -0,0 +1,106 @@
+/*! \file mips_pool.h
+    Re-usable CPU and RAM pairs, for programs which run a very large
+    number of small jobs.
+*/
+#ifndef mips_pool_header
+#define mips_pool_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_pool CPU Pools
+
+    Creating a CPU and a RAM for every job means a handful of allocations
+    and frees, plus (for the RAM) clearing memory that the job will
+    mostly never look at. When each job only runs a few instructions,
+    that set-up cost is larger than the job itself.
+
+    A pool keeps CPU and RAM pairs around after they are released, and
+    hands them out again. On release the RAM is put back to all zeros
+    with \ref mips_mem_ram_reset, which only touches the pages the job
+    wrote to, the CPU is passed to \ref mips_cpu_reset, and its debug
+    level is set back to 0:
+
+        mips_pool_h pool=mips_pool_create(0x10000, 8);
+
+        for(...){
+            mips_cpu_h cpu;
+            mips_mem_h mem;
+            mips_pool_acquire(pool, &cpu, &mem);
+            ... load a program, run it, look at the results ...
+            mips_pool_release(pool, cpu);
+        }
+
+        mips_pool_free(pool);
+
+    A pooled CPU is only as clean as \ref mips_cpu_reset makes it. The
+    registers and pc are guaranteed to be zero, but any other state
+    (such as HI and LO) is up to the CPU implementation, so a job should
+    not rely on it having any particular value.
+
+    Acquiring and releasing can be done from any number of threads at
+    once. Each pair should only be used by one thread at a time.
+
+    \addtogroup mips_pool
+    @{
+*/
+
+/*! Represents a collection of CPU and RAM pairs. \struct mips_pool_impl */
+struct mips_pool_impl;
+
+/*! An opaque handle to a pool. See \ref mips_mem_h for more commentary. */
+typedef struct mips_pool_impl *mips_pool_h;
+
+/*! Creates a pool of CPUs, each attached to its own RAM of cbMem bytes.
+
+    The given number of pairs are created straight away. If more are
+    acquired at once than that, the pool grows.
+
+    Returns an empty handle if the RAMs or CPUs could not be created.
+*/
+mips_pool_h mips_pool_create(
+    uint32_t cbMem,     //!< Size of each RAM in bytes
+    unsigned preallocate    //!< Number of pairs to create up front
+);
+
+/*! Hands out a CPU with its RAM. The CPU is in the reset state and
+    the RAM is all zeros.
+
+    Returns mips_ErrorInvalidHandle if a new pair was needed but could
+    not be created, as \ref mips_cpu_create would have returned an
+    empty handle.
+*/
+mips_error mips_pool_acquire(
+    mips_pool_h pool,   //!< Valid handle to a pool
+    mips_cpu_h *cpu,    //!< Receives the CPU
+    mips_mem_h *mem     //!< Receives the RAM the CPU is attached to
+);
+
+/*! Gives a CPU (and its RAM) back to the pool, so that it can be
+    handed out again. Neither handle may be used after this.
+
+    Returns mips_ErrorInvalidArgument if the CPU was not acquired from
+    this pool, or has already been released.
+*/
+mips_error mips_pool_release(
+    mips_pool_h pool,   //!< Valid handle to a pool
+    mips_cpu_h cpu      //!< CPU returned by \ref mips_pool_acquire
+);
+
+/*! Frees the pool, along with every CPU and RAM it created, including
+    any which are still acquired. Passing an empty handle is legal.
+*/
+void mips_pool_free(mips_pool_h pool);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+/*! \file mips_replay.h
+    Deterministic record and replay of a CPU, with checkpoints so that
+    execution can be moved backwards as well as forwards.
+*/
+#ifndef mips_replay_header
+#define mips_replay_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_replay Record and Replay
+
+    Debugging a failure that happens a billion instructions into a
+    program is painful if the only way to look at the state just
+    before the failure is to run the whole thing again. The replay
+    API wraps a CPU and a RAM, and while the program runs it:
+
+    - logs everything that the host does to the CPU or memory from
+      outside (setting registers, moving the pc, writing memory), as
+      these are the only things that are not decided by the program;
+
+    - every so many instructions, takes a checkpoint of the registers,
+      pc, and the pages of RAM that have been written since the
+      previous checkpoint (see \ref mips_mem_ram_get_dirty_pages).
+
+    Execution of a MIPS program is otherwise deterministic, so to get
+    to any earlier instruction count we can restore the nearest
+    checkpoint before it, then step forwards while re-applying the
+    logged host actions. The cost of a seek is therefore bounded by
+    the checkpoint interval, not by how long the program has run:
+
+        mips_replay_h r=mips_replay_create(cpu, mem, 100000);
+
+        mips_error err=mips_Success;
+        while(!err){
+            err=mips_replay_step(r);
+        }
+
+        // Look at the state one instruction before the failure
+        mips_replay_step_back(r);
+        mips_cpu_get_register(cpu, 4, &a0);
+
+    While a replay object exists, the host must make changes to the
+    CPU and memory through \ref mips_replay_set_register, \ref mips_replay_set_pc
+    and \ref mips_replay_write, rather than calling mips_cpu_set_register
+    and friends directly, or they will not be seen during replay.
+    Making a change at an earlier point than the furthest point
+    recorded discards the rest of the recording, as history has
+    now been changed.
+
+    The CPU is only visible through \ref mips_cpu, which does not expose
+    HI, LO, or whether a branch is waiting for its delay slot. So
+    checkpoints are only taken at instruction boundaries where the
+    previous instruction was not a branch or jump, and a checkpoint that
+    falls due at any other point is deferred until the next boundary
+    where it is safe.
+
+    HI and LO can't be saved, and restoring a checkpoint (which uses
+    \ref mips_cpu_reset) sets them to zero. The checkpoint at instruction
+    zero assumes they are zero, so the CPU should have just been created
+    or reset. A later checkpoint is only restored for positions where
+    that can't be seen: either HI and LO hadn't been written before the
+    checkpoint, or each of them has been written again since it without
+    being read in between. Otherwise an earlier checkpoint is used, so
+    seeks in code which keeps results in HI or LO for a long time can
+    take longer than the checkpoint interval suggests.
+
+    Memory-mapped devices (see \ref mips_mem_map_device) can't be
+    recorded. Reads from a device, such as the timer, are not logged, so
+    they could give different values when replayed, and writes to one,
+    such as the console, would happen again every time a seek passed
+    over them. So \ref mips_replay_create refuses a memory with devices
+    mapped, and none should be mapped on it while it is being recorded.
+
+    \addtogroup mips_replay
+    @{
+*/
+
+/*! Represents a recording of a CPU and its memory. \struct mips_replay_impl */
+struct mips_replay_impl;
+
+/*! An opaque handle to a recording. See \ref mips_mem_h for more commentary. */
+typedef struct mips_replay_impl *mips_replay_h;
+
+/*! Starts recording a CPU attached to a RAM.
+
+    The current state of the CPU and the whole RAM become the checkpoint
+    for instruction zero. The RAM must have been created with
+    \ref mips_mem_create_ram, and it should be the memory the CPU was
+    created with. Neither the CPU nor the memory are owned by the
+    recording.
+
+    Returns an empty handle if the arguments are invalid, the memory has
+    devices mapped, or there is not enough memory.
+*/
+mips_replay_h mips_replay_create(
+    mips_cpu_h cpu,     //!< CPU to record
+    mips_mem_h mem,     //!< RAM the CPU is attached to
+    uint32_t checkpointInterval //!< Minimum number of instructions between checkpoints
+);
+
+/*! Executes one instruction.
+
+    If the position is behind the furthest point recorded then the
+    logged host actions are re-applied as the position passes them,
+    otherwise the recording is extended. If the CPU reports an error
+    then the position does not advance and the error is returned.
+*/
+mips_error mips_replay_step(mips_replay_h h);
+
+/*! Moves to the state just after the given number of instructions
+    have executed, including any host actions made at that point.
+
+    Seeking beyond the end of the recording executes (and records)
+    instructions until the position is reached, or until the CPU
+    reports an error, in which case the error is returned and the
+    position is left at the faulting instruction.
+*/
+mips_error mips_replay_seek(
+    mips_replay_h h,    //!< Valid handle to a recording
+    uint64_t position   //!< Number of instructions executed since creation
+);
+
+/*! Moves back by one instruction. Returns mips_ErrorInvalidArgument if
+    the position is already zero.
+*/
+mips_error mips_replay_step_back(mips_replay_h h);
+
+/*! Returns the number of instructions executed to get to the current state. */
+mips_error mips_replay_get_position(mips_replay_h h, uint64_t *position);
+
+/*! Changes a register, and records the change. See \ref mips_cpu_set_register. */
+mips_error mips_replay_set_register(
+    mips_replay_h h,    //!< Valid handle to a recording
+    unsigned index,     //!< Index from 0 to 31
+    uint32_t value      //!< New value to write into register file
+);
+
+/*! Changes the pc, and records the change. See \ref mips_cpu_set_pc. */
+mips_error mips_replay_set_pc(mips_replay_h h, uint32_t pc);
+
+/*! Writes to memory, and records the write. See \ref mips_mem_write. */
+mips_error mips_replay_write(
+    mips_replay_h h,    //!< Valid handle to a recording
+    uint32_t address,   //!< Byte address to start transaction at
+    uint32_t length,    //!< Number of bytes to transfer
+    const uint8_t *dataIn   //!< Bytes to write
+);
+
+/*! Releases the recording. The CPU and memory are left in their
+    current state. Passing an empty handle is legal.
+*/
+void mips_replay_free(mips_replay_h h);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+/*! \file mips_sched.h
+    Runs a large number of CPUs on a small number of host threads.
+*/
+#ifndef mips_sched_header
+#define mips_sched_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_sched Scheduler
+
+    \ref mips_smp_run gives every CPU its own host thread, which is
+    right for a few busy cores but far too heavy for thousands of small
+    programs that spend most of their time waiting. A scheduler instead
+    shares each host thread between many contexts, each of which is a
+    CPU plus a little bookkeeping, and runs them round-robin in time
+    slices:
+
+        mips_sched_h sched=mips_sched_create(0, 1000);
+        for(...){
+            ... create a CPU, load a program, set its pc ...
+            unsigned id;
+            mips_sched_add(sched, cpu, haltPc, 0, &id);
+        }
+        mips_sched_run(sched);
+        ... look at each context with mips_sched_get_status ...
+        mips_sched_free(sched);
+
+    Switching context is just picking the next CPU handle, so nothing is
+    copied, and each context adds about 40 bytes of state to whatever
+    the CPU itself needs. Contexts are given to the threads when they
+    are added, and stay on the same thread, so a thread only ever
+    touches its own contexts.
+
+    A context runs until the end of its slice, and then goes to the back
+    of its thread's queue. It stops for good when its pc reaches its
+    halt address, a step or reading its pc returns an error, or it has
+    run its maximum number of steps.
+
+    A context can also reach one of the scheduler's breakpoints, at
+    which point a callback decides whether it carries on, halts, or
+    blocks. A blocked context is not run again until something calls
+    \ref mips_sched_wake for it; this is how a context waits for input,
+    or for another context, without using any host time.
+
+    \addtogroup mips_sched
+    @{
+*/
+
+/*! Represents a set of contexts and the threads that run them. \struct mips_sched_impl */
+struct mips_sched_impl;
+
+/*! An opaque handle to a scheduler. See \ref mips_mem_h for more commentary. */
+typedef struct mips_sched_impl *mips_sched_h;
+
+/*! What a context is currently doing. */
+typedef enum mips_sched_state{
+    mips_sched_Ready=0,     //!< Will run when its turn comes
+    mips_sched_Blocked=1,   //!< Waiting for \ref mips_sched_wake
+    mips_sched_Halted=2,    //!< Reached its halt pc (or halted by a breakpoint)
+    mips_sched_Failed=3,    //!< A step, or reading the pc, returned an error
+    mips_sched_Limited=4    //!< Ran its maximum number of steps
+}mips_sched_state;
+
+/*! How far a context got. */
+typedef struct mips_sched_status
+{
+    mips_sched_state state;
+    mips_error err;     //!< Error that failed the context, when state is mips_sched_Failed
+    uint64_t steps;     //!< Number of instructions the context has completed
+} mips_sched_status;
+
+/*! Called when a context reaches a breakpoint, before the instruction
+    there is run.
+
+    The callback can look at and change the CPU, including its pc,
+    and can wake other contexts. It returns the state the context should
+    be in, which is one of:
+
+    - mips_sched_Ready : carry on. The breakpoint doesn't trigger again
+      until the context has moved on from it.
+    - mips_sched_Blocked : stop running until woken, then carry on
+      as for mips_sched_Ready.
+    - mips_sched_Halted : stop for good.
+
+    Callbacks can be made from several threads at once, for different
+    contexts.
+*/
+typedef mips_sched_state (*mips_sched_break_fn)(
+    void *param,        //!< The value given to \ref mips_sched_set_break_handler
+    mips_sched_h sched,
+    unsigned id,        //!< Context that reached the breakpoint
+    mips_cpu_h cpu      //!< CPU of that context
+);
+
+/*! Creates an empty scheduler.
+
+    \param threads Number of host threads to run contexts on, or zero for
+        one per host core.
+    \param slice Number of instructions a context runs before the next
+        one on its thread gets a turn.
+
+    Returns an empty handle if slice is zero.
+*/
+mips_sched_h mips_sched_create(unsigned threads, uint32_t slice);
+
+/*! Adds a context which runs the given CPU from its current pc.
+
+    \param haltPc Reaching this pc halts the context.
+    \param maxSteps Limit on the instructions the context runs in total,
+        or zero for none.
+    \param id Receives the number of the context. Contexts are numbered
+        from zero in the order they are added.
+
+    Each CPU can only be in one context, and each CPU must have its own
+    memory handle (or core view, see \ref mips_mem_create_core_view),
+    as contexts on different threads run at the same time. Contexts can
+    only be added while the scheduler isn't running.
+*/
+mips_error mips_sched_add(
+    mips_sched_h sched,
+    mips_cpu_h cpu,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    unsigned *id
+);
+
+/*! Sets the function called when a context reaches a breakpoint. */
+mips_error mips_sched_set_break_handler(mips_sched_h sched, mips_sched_break_fn handler, void *param);
+
+/*! Adds a breakpoint, which applies to every context. This can only
+    be done while the scheduler isn't running. */
+mips_error mips_sched_add_breakpoint(mips_sched_h sched, uint32_t pc);
+
+/*! Runs contexts until none of them are ready.
+
+    Returns once every context has halted, failed, reached its limit,
+    or is blocked. Blocked contexts can then be woken and the scheduler
+    run again.
+*/
+mips_error mips_sched_run(mips_sched_h sched);
+
+/*! Makes a blocked context ready to run again. This can be called from
+    a breakpoint callback, or while the scheduler isn't running.
+
+    Returns mips_ErrorInvalidArgument if there is no such context, and
+    does nothing if the context isn't blocked.
+*/
+mips_error mips_sched_wake(mips_sched_h sched, unsigned id);
+
+/*! Returns how far a context has got. This shouldn't be called for a
+    context which might be running. */
+mips_error mips_sched_get_status(mips_sched_h sched, unsigned id, mips_sched_status *status);
+
+/*! Frees the scheduler, but not the CPUs it was running. Passing an
+    empty handle is legal. */
+void mips_sched_free(mips_sched_h sched);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
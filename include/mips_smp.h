@@ -0,0 +1,109 @@
+/*! \file mips_smp.h
+    Runs several CPUs at once on host threads, sharing one RAM.
+*/
+#ifndef mips_smp_header
+#define mips_smp_header
+
+#include "mips_cpu.h"
+
+/* This allows the header to be used from both C and C++, so
+programs can be written in either (or both) languages. */
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/*! \defgroup mips_smp Multi-core Simulation
+
+    A multi-core system is built from one RAM, one view of it per core
+    from \ref mips_mem_create_core_view, and one CPU attached to each
+    view:
+
+        mips_mem_h ram=mips_mem_create_ram(0x100000);
+        ... load the program into ram ...
+
+        std::vector<mips_mem_h> views(n);
+        std::vector<mips_cpu_h> cpus(n);
+        for(unsigned i=0; i<n; i++){
+            views[i]=mips_mem_create_core_view(ram, i, MIPS_SMP_CORE_ID_ADDRESS);
+            cpus[i]=mips_cpu_create(views[i]);
+            mips_cpu_set_pc(cpus[i], entry);
+            ... give each core its own stack pointer ...
+        }
+
+        std::vector<mips_smp_result> results(n);
+        mips_smp_run(n, &cpus[0], haltPc, 0, 1000, &results[0]);
+
+    Each core then runs on its own host thread. Every transaction on
+    the RAM is atomic, so a word written by one core is never seen
+    half-written by another, and writes by a core are seen by the
+    others in the order it made them. That is release/acquire ordering
+    only: a write followed by a read of a different address can appear
+    to the other cores in the opposite order, so Peterson's and Dekker's
+    algorithms don't work. There is no LL/SC or SYNC in the instructions
+    we simulate either, so software should give each core its own region
+    of memory to write to, and pass messages through flags that only one
+    core ever writes.
+
+    Cores can either run freely, or in quanta. In quantum mode every
+    core runs a fixed number of instructions and then waits for the
+    others to catch up, so no core is ever more than one quantum ahead
+    of any other. Small quanta keep the cores close together (which
+    helps software that spins waiting on other cores), while large
+    quanta mean the threads synchronise less often and spend more of
+    their time simulating.
+
+    A CPU implementation can be used for this as long as separate CPU
+    instances don't share any global state.
+
+    \addtogroup mips_smp
+    @{
+*/
+
+/*! Suggested address for the core ID register, as the last word of
+    the address space can be read with a single instruction:
+
+        lw $t0, -4($zero)
+*/
+#define MIPS_SMP_CORE_ID_ADDRESS 0xFFFFFFFCu
+
+/*! How one core finished. */
+typedef struct mips_smp_result
+{
+    mips_error err;     //!< Error from the step that stopped the core, or mips_Success
+    int halted;         //!< Non-zero if the core reached the halt pc
+    uint64_t steps;     //!< Number of instructions the core completed
+} mips_smp_result;
+
+/*! Runs the CPUs, each on its own thread, until every one has stopped.
+
+    A core stops when its pc reaches haltPc, when a step returns an
+    error, or when it has completed maxSteps instructions. If any core
+    stops with an error then the others stop as well, at the end of
+    their current quantum, as a program which has lost one of its cores
+    will usually never finish.
+
+    \param quantum Number of instructions each core runs between
+        synchronisations, or zero to let the cores run freely.
+    \param maxSteps Limit on the instructions per core, or zero for none.
+    \param results Receives how each core finished, can be NULL.
+
+    Returns the error of the lowest numbered core which stopped with
+    an error, or mips_Success if none did. Cores which ran out of steps
+    are only reported through results.
+*/
+mips_error mips_smp_run(
+    unsigned count,             //!< Number of CPUs
+    const mips_cpu_h *cpus,     //!< The CPUs, each attached to a different core view
+    uint32_t haltPc,            //!< Reaching this pc stops a core
+    uint64_t maxSteps,
+    uint32_t quantum,
+    mips_smp_result *results
+);
+
+/*! @} */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -137,9 +137,168 @@ void mips_test_end_test(int testId, int passed, const char *msg);
 
 /*! Call once at the end of all tests to indicate that all tests
     have now ended.
+    
+    This prints a summary table to stderr. If reports have been asked
+    for, either with \ref mips_test_suite_report_to or by setting the
+    environment variables MIPS_TEST_JSON and MIPS_TEST_JUNIT to file
+    names, then the results are also written as JSON and as JUnit XML.
+    The reports include how long each test took, measured with a
+    monotonic clock from mips_test_begin_test to mips_test_end_test.
 */
 void mips_test_end_suite();
 
+/*! Records how many instructions a test executed, so that the
+    reports can show time per instruction as well as per test.
+    
+    The CPU API does not count instructions, so this is up to the
+    test, which will usually know how many times it called
+    mips_cpu_step. It must be called between mips_test_begin_test
+    and mips_test_end_test.
+*/
+void mips_test_set_instructions(int testId, uint64_t count);
+
+/*! \defgroup mips_test_parallel Parallel Testing
+    \ingroup mips_test
+    
+    The functions above work on one global test suite, and only allow
+    one test to be open at a time, so every test in a program has to
+    run one after the other. Most instruction tests are independent
+    of each other though: each one sets up a CPU and some memory, runs
+    a few instructions, then checks the result. Those tests can run
+    at the same time on different threads, as long as each has its
+    own CPU and memory.
+    
+    To do that, put each group of tests into a function, and register
+    it rather than calling it directly:
+    
+        void test_addu(mips_test_suite_h suite, mips_cpu_h cpu, mips_mem_h mem, void *arg)
+        {
+            int testId=mips_test_suite_begin_test(suite, "ADDU");
+            ...
+            mips_test_suite_end_test(suite, testId, passed, "Testing 5+5 == 10");
+        }
+        
+        mips_test_begin_suite();
+        
+        mips_test_suite_h suite=mips_test_current_suite();
+        mips_test_suite_register(suite, test_addu, NULL, 0x1000);
+        mips_test_suite_register(suite, test_subu, NULL, 0x1000);
+        ...
+        mips_test_suite_run(suite, 0);  // Use all the cores
+        
+        mips_test_end_suite();
+    
+    Each registered function is called exactly once, on some thread,
+    with a CPU and RAM from a \ref mips_pool, which are reset and handed
+    on to a later function when it returns. So the RAM is all zeros and
+    the debug level is 0, but (as for \ref mips_cpu_reset) any CPU
+    state beyond the registers and pc may be left over from an earlier
+    function. Results are merged back in the order the functions
+    were registered, so the summary printed by mips_test_end_suite
+    is the same whatever the number of threads.
+    
+    Within a registered function the original mips_test_begin_test and
+    mips_test_end_test can still be used, as they act on the suite of
+    whichever function is running on the calling thread. So existing
+    tests can be moved into functions without being rewritten.
+    
+    This only works if the CPU implementation keeps all of its state
+    inside the mips_cpu_h, rather than in global variables.
+    
+    \addtogroup mips_test_parallel
+    @{
+*/
+
+/*! Represents a collection of test results. \struct mips_test_suite_impl */
+struct mips_test_suite_impl;
+
+/*! An opaque handle to a test suite. See \ref mips_mem_h for more commentary. */
+typedef struct mips_test_suite_impl *mips_test_suite_h;
+
+/*! A function containing one or more tests, which can be registered
+    with \ref mips_test_suite_register.
+    
+    \param suite Suite that tests should be recorded in. This is private
+        to this call, so doesn't need any locking.
+    
+    \param cpu A CPU created just for this call, attached to mem.
+    
+    \param mem A RAM created just for this call.
+    
+    \param arg The pointer that was passed in when registering.
+*/
+typedef void (*mips_test_fn)(mips_test_suite_h suite, mips_cpu_h cpu, mips_mem_h mem, void *arg);
+
+/*! Returns the suite used by mips_test_begin_test and mips_test_end_test
+    on the calling thread.
+    
+    Within a registered test function this is the suite passed to the
+    function, otherwise it is the suite started by mips_test_begin_suite.
+*/
+mips_test_suite_h mips_test_current_suite();
+
+/*! Equivalent of \ref mips_test_begin_test for a particular suite. */
+int mips_test_suite_begin_test(mips_test_suite_h suite, const char *instruction);
+
+/*! Equivalent of \ref mips_test_end_test for a particular suite. */
+void mips_test_suite_end_test(mips_test_suite_h suite, int testId, int passed, const char *msg);
+
+/*! Equivalent of \ref mips_test_set_instructions for a particular suite. */
+void mips_test_suite_set_instructions(mips_test_suite_h suite, int testId, uint64_t count);
+
+/*! Asks for JSON and/or JUnit XML reports to be written when the
+    suite ends. Either path can be NULL to leave that report as it
+    was. This overrides the MIPS_TEST_JSON and MIPS_TEST_JUNIT
+    environment variables.
+*/
+void mips_test_suite_report_to(mips_test_suite_h suite, const char *jsonPath, const char *junitPath);
+
+/*! Adds a test function to be called by \ref mips_test_suite_run.
+    
+    \param suite The suite to add the results to.
+    
+    \param fn Function containing the tests.
+    
+    \param arg Passed unchanged to fn.
+    
+    \param cbMem Size of the RAM to create for the function.
+*/
+void mips_test_suite_register(mips_test_suite_h suite, mips_test_fn fn, void *arg, uint32_t cbMem);
+
+/*! Calls all the functions registered since the last run, using up to
+    the given number of threads, then adds their results to the suite.
+    
+    \param suite Suite whose functions should be run. Must not be
+        the suite of a registered function.
+    
+    \param threads Number of threads to use, or 0 to use one per core.
+*/
+void mips_test_suite_run(mips_test_suite_h suite, unsigned threads);
+
+/*! Switches a suite to streaming mode, for when there are far too many
+    tests (for example randomly generated ones) to keep them all.
+    
+    Normally the framework keeps a record of every test until the end
+    of the suite. In streaming mode the pass/fail counts for each
+    instruction are updated as each test ends, passed tests are then
+    forgotten, and failed tests are appended to the given file as
+    lines of the form:
+    
+        testId <tab> INSTRUCTION <tab> message
+    
+    so memory use does not grow with the number of tests. If
+    failuresPath is NULL the failed tests are kept in memory instead.
+    The summary printed by mips_test_end_suite is the same in
+    either mode.
+    
+    \param suite Suite to switch, which must not have started any tests yet.
+    
+    \param failuresPath File to write failed tests to, or NULL.
+*/
+void mips_test_suite_stream(mips_test_suite_h suite, const char *failuresPath);
+
+/*! @} */
+
 /*! @} */    
     
 
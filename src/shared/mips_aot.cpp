@@ -0,0 +1,253 @@
+/* This file is an implementation of the functions
+   defined in mips_aot.h. It only uses the public
+   CPU and memory APIs, plus the instruction descriptions
+   from mips_isa.h.
+*/
+#include "mips_aot.h"
+#include "mips_isa.h"
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#include <unistd.h>
+#define AOT_HAVE_DLOPEN 1
+#endif
+
+struct mips_aot_impl
+{
+    void *library;
+    const mips_aot_module *module;
+    mips_aot_env env;
+};
+
+extern "C" uint64_t mips_aot_hash(const uint8_t *data, uint32_t length)
+{
+    uint64_t h=0xcbf29ce484222325ull;
+    for(uint32_t i=0; i<length; i++){
+        h=(h^data[i])*0x100000001b3ull;
+    }
+    return h;
+}
+
+extern "C" mips_aot_h mips_aot_open(const char *path)
+{
+#ifdef AOT_HAVE_DLOPEN
+    void *library=dlopen(path, RTLD_NOW|RTLD_LOCAL);
+    if(library==0){
+        return 0;
+    }
+    const mips_aot_module *module=(const mips_aot_module*)dlsym(library, MIPS_AOT_SYMBOL);
+    if(module==0 || module->version!=MIPS_AOT_VERSION){
+        dlclose(library);
+        return 0;
+    }
+
+    mips_aot_h aot=new mips_aot_impl;
+    aot->library=library;
+    aot->module=module;
+    aot->env.cpu_get_register=mips_cpu_get_register;
+    aot->env.cpu_set_register=mips_cpu_set_register;
+    aot->env.cpu_get_pc=mips_cpu_get_pc;
+    aot->env.cpu_set_pc=mips_cpu_set_pc;
+    aot->env.mem_read=mips_mem_read;
+    aot->env.mem_write=mips_mem_write;
+    return aot;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+extern "C" mips_error mips_aot_check(mips_aot_h aot, mips_mem_h mem)
+{
+    if(aot==0 || mem==0){
+        return mips_ErrorInvalidHandle;
+    }
+    const mips_aot_module *module=aot->module;
+    std::vector<uint8_t> image(module->length);
+    for(uint32_t i=0; i<module->length; i+=4){
+        mips_error err=mips_mem_read(mem, module->base+i, 4, &image[i]);
+        if(err){
+            return err;
+        }
+    }
+    if(mips_aot_hash(image.empty() ? 0 : &image[0], module->length)!=module->hash){
+        return mips_ErrorInvalidArgument;
+    }
+    return mips_Success;
+}
+
+/* Whether the instruction at pc is a branch or jump, so the next
+   instruction is in its delay slot. Anything that can't be read or
+   decoded is treated as not having one. */
+static bool aot_has_delay_slot(mips_mem_h mem, uint32_t pc)
+{
+    uint8_t bytes[4];
+    if(mips_mem_read(mem, pc, 4, bytes)){
+        return false;
+    }
+    int index=mips_isa_decode((bytes[0]<<24) | (bytes[1]<<16) | (bytes[2]<<8) | bytes[3]);
+    return index>=0 && (mips_isa_get(index)->flags & (mips_isa_Branch | mips_isa_Jump));
+}
+
+extern "C" mips_error mips_aot_run(
+    mips_aot_h aot,
+    mips_cpu_h cpu,
+    mips_mem_h mem,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    uint64_t *steps
+){
+    if(aot==0 || cpu==0 || mem==0){
+        return mips_ErrorInvalidHandle;
+    }
+
+    const mips_aot_module *module=aot->module;
+    uint64_t count=0;
+    mips_error err=mips_Success;
+    while(true){
+        int interpret=0;
+        err=module->run(&aot->env, cpu, mem, haltPc, maxSteps, &count, &interpret);
+        if(err || !interpret){
+            break;
+        }
+
+        /* Step the CPU until it gets back to a known block. It can't go
+           back into translated code in a delay slot, as the pending
+           branch is inside the CPU. */
+        uint32_t pc;
+        err=mips_cpu_get_pc(cpu, &pc);
+        if(err){
+            break;
+        }
+        bool inDelaySlot=false;
+        do{
+            if(pc==haltPc || (maxSteps && count>=maxSteps)){
+                break;
+            }
+            bool branch=aot_has_delay_slot(mem, pc);
+            err=mips_cpu_step(cpu);
+            if(err){
+                break;
+            }
+            count++;
+            inDelaySlot=branch;
+            err=mips_cpu_get_pc(cpu, &pc);
+            if(err){
+                break;
+            }
+        }while(inDelaySlot || !module->known(pc));
+
+        if(err || pc==haltPc || (maxSteps && count>=maxSteps)){
+            break;
+        }
+    }
+    if(steps){
+        *steps=count;
+    }
+    return err;
+}
+
+extern "C" void mips_aot_get_image(mips_aot_h aot, uint32_t *base, uint32_t *length)
+{
+    *base=aot->module->base;
+    *length=aot->module->length;
+}
+
+/* Opens a library, and only keeps it if it matches the memory. */
+static mips_aot_h aot_open_checked(const char *path, mips_mem_h mem)
+{
+    mips_aot_h aot=mips_aot_open(path);
+    if(aot && mips_aot_check(aot, mem)){
+        mips_aot_close(aot);
+        aot=0;
+    }
+    return aot;
+}
+
+extern "C" mips_aot_h mips_aot_cache_load(
+    const char *dir,
+    const char *compiler,
+    mips_mem_h mem,
+    uint32_t base,
+    uint32_t length
+){
+#ifdef AOT_HAVE_DLOPEN
+    // Paths are passed to the shell in single quotes
+    if(dir==0 || mem==0 || (base&3) || strchr(dir, '\'')){
+        return 0;
+    }
+    if(compiler==0){
+        compiler=MIPS_AOT_DEFAULT_COMPILER;
+    }
+
+    length=(length+3)&~3u;
+    std::vector<uint8_t> image(length);
+    for(uint32_t i=0; i<length; i+=4){
+        if(mips_mem_read(mem, base+i, 4, &image[i])){
+            return 0;
+        }
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/mips-aot-v%u-%016llx-%08x", MIPS_AOT_VERSION,
+        (unsigned long long)mips_aot_hash(image.empty() ? 0 : &image[0], length), base);
+    std::string path=std::string(dir)+name+".so";
+
+    mips_aot_h aot=aot_open_checked(path.c_str(), mem);
+    if(aot){
+        return aot;
+    }
+
+    /* Not seen before (or not usable), so build it under a name no other
+       process, or other thread of this one, is using */
+    static std::atomic<unsigned> builds(0);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.%u", (long)getpid(), builds++);
+    std::string temp=std::string(dir)+name+suffix;
+    std::string source=temp+".cpp", library=temp+".so";
+
+    FILE *dst=fopen(source.c_str(), "w");
+    if(!dst){
+        return 0;
+    }
+    char sourceName[64];
+    snprintf(sourceName, sizeof(sourceName), "the image at 0x%08x", base);
+    mips_error err=mips_aot_translate(dst, sourceName, base, image.empty() ? 0 : &image[0], length, 0, 0);
+    if(fclose(dst) || err){
+        remove(source.c_str());
+        return 0;
+    }
+
+    std::string command=std::string(compiler)+" -o '"+library+"' '"+source+"'";
+    int res=system(command.c_str());
+    remove(source.c_str());
+    if(res!=0 || rename(library.c_str(), path.c_str())){
+        remove(library.c_str());
+        return 0;
+    }
+    return aot_open_checked(path.c_str(), mem);
+#else
+    (void)dir;
+    (void)compiler;
+    (void)mem;
+    (void)base;
+    (void)length;
+    return 0;
+#endif
+}
+
+extern "C" void mips_aot_close(mips_aot_h aot)
+{
+    if(aot){
+#ifdef AOT_HAVE_DLOPEN
+        dlclose(aot->library);
+#endif
+        delete aot;
+    }
+}
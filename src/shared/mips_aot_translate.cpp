@@ -0,0 +1,465 @@
+/* This file is an implementation of mips_aot_translate,
+   defined in mips_aot.h.
+
+   Every word of the image is translated as if it were an instruction
+   (a linear sweep), so data mixed in with the code just turns into
+   code that is never run. The start of a block is anywhere that can be
+   reached other than by falling through: entry points, the targets of
+   branches and J/JAL, and the instruction after each delay slot, which
+   is where calls return to. Indirect jumps look the target up in a
+   switch over the block starts.
+
+   The generated function keeps the registers in a local array. Each
+   instruction becomes a line or two of C++, branches become gotos, and
+   a branch and its delay slot are translated together, with the
+   condition worked out before the delay slot runs. Anything that can't
+   be translated is handed back to the CPU to step, and the instruction
+   after it is made the start of a block so that translated code can
+   pick up again there.
+*/
+#include "mips_aot.h"
+#include "mips_isa.h"
+
+#include <vector>
+#include <set>
+#include <string>
+#include <stdarg.h>
+#include <string.h>
+
+struct aot_image_t
+{
+    uint32_t base;
+    std::vector<uint32_t> words;
+
+    uint32_t end() const { return base+4*words.size(); }
+    bool contains(uint32_t pc) const { return pc-base < 4*words.size() && (pc&3)==0; }
+    uint32_t at(uint32_t pc) const { return words[(pc-base)/4]; }
+};
+
+static std::string aot_format(const char *fmt, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+    return buffer;
+}
+
+static const mips_isa_info *aot_info(uint32_t instr)
+{
+    int index=mips_isa_decode(instr);
+    return index>=0 ? mips_isa_get(index) : 0;
+}
+
+static bool aot_is_control(uint32_t instr)
+{
+    const mips_isa_info *info=aot_info(instr);
+    return info && (info->flags & (mips_isa_Branch | mips_isa_Jump));
+}
+
+static uint32_t aot_simm(uint32_t instr)
+{
+    return (uint32_t)(int32_t)(int16_t)(instr&0xFFFF);
+}
+
+/* Translates an instruction which isn't a branch or jump, with any
+   error reported at pc. Returns false if it has to be stepped by the
+   CPU instead. */
+static bool aot_simple(uint32_t pc, uint32_t instr, std::string &code)
+{
+    const mips_isa_info *info=aot_info(instr);
+    if(info==0 || (info->flags & (mips_isa_Branch | mips_isa_Jump | mips_isa_ReadsHiLo | mips_isa_WritesHiLo))){
+        return false;
+    }
+
+    uint32_t opcode=instr>>26, funct=instr&0x3F;
+    unsigned rs=(instr>>21)&0x1F, rt=(instr>>16)&0x1F, rd=(instr>>11)&0x1F, shamt=(instr>>6)&0x1F;
+    uint32_t imm=instr&0xFFFF, simm=aot_simm(instr);
+    std::string fault=aot_format("AOT_FAULT(0x%08xu, e)", pc);
+
+    // Which register is written (0 means the result is thrown away), and the expression for it
+    unsigned dst = opcode==0 ? rd : rt;
+    std::string value;
+
+    if(opcode==0){
+        std::string a=aot_format("r[%u]", rs), b=aot_format("r[%u]", rt);
+        switch(funct){
+        case 0x00:  value=aot_format("%s<<%u", b.c_str(), shamt);    break;
+        case 0x02:  value=aot_format("%s>>%u", b.c_str(), shamt);    break;
+        case 0x03:  value=aot_format("(uint32_t)((int32_t)%s>>%u)", b.c_str(), shamt);  break;
+        case 0x04:  value=aot_format("%s<<(%s&31)", b.c_str(), a.c_str());  break;
+        case 0x06:  value=aot_format("%s>>(%s&31)", b.c_str(), a.c_str());  break;
+        case 0x07:  value=aot_format("(uint32_t)((int32_t)%s>>(%s&31))", b.c_str(), a.c_str());    break;
+        case 0x20:
+            code+=aot_format("    { uint32_t a=%s, b=%s, v=a+b; if((a^v)&(b^v)&0x80000000u){ mips_error e=mips_ExceptionArithmeticOverflow; %s; }",
+                a.c_str(), b.c_str(), fault.c_str());
+            code+= rd ? aot_format(" r[%u]=v; }\n", rd) : std::string(" }\n");
+            return true;
+        case 0x22:
+            code+=aot_format("    { uint32_t a=%s, b=%s, v=a-b; if((a^b)&(a^v)&0x80000000u){ mips_error e=mips_ExceptionArithmeticOverflow; %s; }",
+                a.c_str(), b.c_str(), fault.c_str());
+            code+= rd ? aot_format(" r[%u]=v; }\n", rd) : std::string(" }\n");
+            return true;
+        case 0x21:  value=a+"+"+b;  break;
+        case 0x23:  value=a+"-"+b;  break;
+        case 0x24:  value=a+"&"+b;  break;
+        case 0x25:  value=a+"|"+b;  break;
+        case 0x26:  value=a+"^"+b;  break;
+        case 0x2A:  value=aot_format("(uint32_t)((int32_t)%s<(int32_t)%s)", a.c_str(), b.c_str());    break;
+        case 0x2B:  value=aot_format("(uint32_t)(%s<%s)", a.c_str(), b.c_str());  break;
+        default:
+            return false;
+        }
+    }else{
+        std::string address=aot_format("r[%u]+0x%08xu", rs, simm);
+        switch(opcode){
+        case 0x08:
+            code+=aot_format("    { uint32_t a=r[%u], v=a+0x%08xu; if((a^v)&(0x%08xu^v)&0x80000000u){ mips_error e=mips_ExceptionArithmeticOverflow; %s; }",
+                rs, simm, simm, fault.c_str());
+            code+= rt ? aot_format(" r[%u]=v; }\n", rt) : std::string(" }\n");
+            return true;
+        case 0x09:  value=aot_format("r[%u]+0x%08xu", rs, simm);  break;
+        case 0x0A:  value=aot_format("(uint32_t)((int32_t)r[%u]<%d)", rs, (int32_t)simm);  break;
+        case 0x0B:  value=aot_format("(uint32_t)(r[%u]<0x%08xu)", rs, simm); break;
+        case 0x0C:  value=aot_format("r[%u]&0x%04xu", rs, imm);    break;
+        case 0x0D:  value=aot_format("r[%u]|0x%04xu", rs, imm);    break;
+        case 0x0E:  value=aot_format("r[%u]^0x%04xu", rs, imm);    break;
+        case 0x0F:  value=aot_format("0x%08xu", imm<<16);    break;
+        case 0x20:
+        case 0x21:
+        case 0x23:
+        case 0x24:
+        case 0x25:{
+            unsigned length = (opcode&3)==0 ? 1 : (opcode&3)==1 ? 2 : 4;
+            const char *extend = opcode==0x20 ? "(uint32_t)(int32_t)(int8_t)" : opcode==0x21 ? "(uint32_t)(int32_t)(int16_t)" : "";
+            code+=aot_format("    { uint32_t v; mips_error e=aot_load(env, mem, %s, %u, &v); if(e){ %s; }",
+                address.c_str(), length, fault.c_str());
+            code+= rt ? aot_format(" r[%u]=%sv; }\n", rt, extend) : std::string(" }\n");
+            return true;
+        }
+        case 0x22:
+        case 0x26:{
+            code+=aot_format("    { uint32_t address=%s, v; mips_error e=aot_load(env, mem, address&~3u, 4, &v); if(e){ %s; }",
+                address.c_str(), fault.c_str());
+            if(rt){
+                code+=aot_format(" r[%u]=%s(v, r[%u], address&3);", rt, opcode==0x22 ? "aot_lwl" : "aot_lwr", rt);
+            }
+            code+=" }\n";
+            return true;
+        }
+        case 0x28:
+        case 0x29:
+        case 0x2B:{
+            unsigned length = opcode==0x28 ? 1 : opcode==0x29 ? 2 : 4;
+            code+=aot_format("    { mips_error e=aot_store(env, mem, %s, %u, r[%u]); if(e){ %s; } }\n",
+                address.c_str(), length, rt, fault.c_str());
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if(dst){
+        code+=aot_format("    r[%u]=%s;\n", dst, value.c_str());
+    }else{
+        code+="    ;\n";
+    }
+    return true;
+}
+
+/* Code to carry on at pc, which is either a block of ours (checking
+   the limit first, as this could be a loop) or anywhere else through
+   the dispatch switch. The halt pc is checked at every instruction. */
+static std::string aot_goto(const aot_image_t &image, const std::set<uint32_t> &leaders, uint32_t pc)
+{
+    if(image.contains(pc) && leaders.count(pc)){
+        return aot_format("{ if(steps>=limit){ pc=0x%08xu; goto dispatch; } goto L_%08x; }", pc, pc);
+    }
+    return aot_format("{ pc=0x%08xu; goto dispatch; }", pc);
+}
+
+/* Translates a branch or jump at pc along with its delay slot. Returns
+   false if the pair has to be stepped by the CPU. */
+static bool aot_control(const aot_image_t &image, const std::set<uint32_t> &leaders, uint32_t pc, std::string &code)
+{
+    if(!image.contains(pc+4) || aot_is_control(image.at(pc+4))){
+        return false;
+    }
+    std::string slot;
+    if(!aot_simple(pc+4, image.at(pc+4), slot)){
+        return false;
+    }
+
+    uint32_t instr=image.at(pc);
+    uint32_t opcode=instr>>26;
+    unsigned rs=(instr>>21)&0x1F, rt=(instr>>16)&0x1F, rd=(instr>>11)&0x1F;
+    uint32_t branchTarget=pc+4+(aot_simm(instr)<<2);
+    uint32_t jumpTarget=((pc+4)&0xF0000000u) | ((instr&0x03FFFFFFu)<<2);
+
+    std::string condition;
+    bool indirect=false, link=false;
+    unsigned linkReg=31;
+    uint32_t target=branchTarget;
+
+    switch(opcode){
+    case 0x00:
+        indirect=true;
+        link=(instr&0x3F)==0x09;
+        linkReg=rd;
+        break;
+    case 0x01:{
+        unsigned kind=rt&1;     // BLTZ(AL) or BGEZ(AL)
+        condition=aot_format(kind ? "(int32_t)r[%u]>=0" : "(int32_t)r[%u]<0", rs);
+        link=(rt&0x10)!=0;
+        break;
+    }
+    case 0x02:  target=jumpTarget;  break;
+    case 0x03:  target=jumpTarget;  link=true;  break;
+    case 0x04:  condition=aot_format("r[%u]==r[%u]", rs, rt);   break;
+    case 0x05:  condition=aot_format("r[%u]!=r[%u]", rs, rt);   break;
+    case 0x06:  condition=aot_format("(int32_t)r[%u]<=0", rs);  break;
+    case 0x07:  condition=aot_format("(int32_t)r[%u]>0", rs);   break;
+    default:
+        return false;
+    }
+
+    // The condition and target are read before the link or delay slot can change them
+    if(indirect){
+        code+=aot_format("    target=r[%u];\n", rs);
+    }
+    if(!condition.empty()){
+        code+="    taken="+condition+";\n";
+    }
+    if(link && linkReg){
+        code+=aot_format("    r[%u]=0x%08xu;\n", linkReg, pc+8);
+    }
+    code+="    steps++;\n";
+    code+=slot;
+    code+="    steps++;\n";
+
+    if(indirect){
+        code+="    pc=target; goto dispatch;\n";
+    }else if(condition.empty()){
+        code+="    "+aot_goto(image, leaders, target)+"\n";
+    }else{
+        code+="    if(taken) "+aot_goto(image, leaders, target)+"\n";
+        code+="    "+aot_goto(image, leaders, pc+8)+"\n";
+    }
+    return true;
+}
+
+/* Finds every pc that needs a label. */
+static std::set<uint32_t> aot_find_leaders(const aot_image_t &image, const std::vector<uint32_t> &entries)
+{
+    std::set<uint32_t> leaders(entries.begin(), entries.end());
+    for(uint32_t pc=image.base; pc<image.end(); pc+=4){
+        uint32_t instr=image.at(pc);
+        const mips_isa_info *info=aot_info(instr);
+        if(info && (info->flags & (mips_isa_Branch | mips_isa_Jump))){
+            leaders.insert(pc+8);
+            if(info->flags & mips_isa_Branch){
+                leaders.insert(pc+4+(aot_simm(instr)<<2));
+            }else if((instr>>26)!=0){
+                leaders.insert(((pc+4)&0xF0000000u) | ((instr&0x03FFFFFFu)<<2));
+            }
+        }else{
+            std::string ignored;
+            if(!aot_simple(pc, instr, ignored)){
+                leaders.insert(pc+4);   // Where the CPU hands back to us
+            }
+        }
+    }
+
+    // Only block starts inside the image can be jumped to
+    std::set<uint32_t> res;
+    for(std::set<uint32_t>::const_iterator it=leaders.begin(); it!=leaders.end(); ++it){
+        if(image.contains(*it)){
+            res.insert(*it);
+        }
+    }
+    return res;
+}
+
+static const char *sg_prologue =
+    "#include \"mips_aot.h\"\n"
+    "\n"
+    "#define AOT_FAULT(at, code) do{ pc=(at); err=(code); goto leave; }while(0)\n"
+    "\n"
+    "static inline mips_error aot_load(const mips_aot_env *env, mips_mem_h mem, uint32_t address, uint32_t length, uint32_t *value)\n"
+    "{\n"
+    "    uint8_t b[4];\n"
+    "    mips_error e=env->mem_read(mem, address, length, b);\n"
+    "    uint32_t v=0;\n"
+    "    for(uint32_t i=0; i<length; i++){\n"
+    "        v=(v<<8) | b[i];\n"
+    "    }\n"
+    "    *value=v;\n"
+    "    return e;\n"
+    "}\n"
+    "\n"
+    "static inline mips_error aot_store(const mips_aot_env *env, mips_mem_h mem, uint32_t address, uint32_t length, uint32_t value)\n"
+    "{\n"
+    "    uint8_t b[4];\n"
+    "    for(uint32_t i=0; i<length; i++){\n"
+    "        b[i]=(uint8_t)(value>>(8*(length-1-i)));\n"
+    "    }\n"
+    "    return env->mem_write(mem, address, length, b);\n"
+    "}\n"
+    "\n"
+    "static inline uint32_t aot_lwl(uint32_t w, uint32_t old, uint32_t k)\n"
+    "{\n"
+    "    return k==0 ? w : (w<<(8*k)) | (old & ((1u<<(8*k))-1));\n"
+    "}\n"
+    "\n"
+    "static inline uint32_t aot_lwr(uint32_t w, uint32_t old, uint32_t k)\n"
+    "{\n"
+    "    return k==3 ? w : (w>>(8*(3-k))) | (old & ~(0xFFFFFFFFu>>(8*(3-k))));\n"
+    "}\n"
+    "\n";
+
+static void aot_write(FILE *dst, const char *sourceName, const aot_image_t &image, const std::vector<uint32_t> &entries)
+{
+    std::set<uint32_t> leaders=aot_find_leaders(image, entries);
+
+    std::vector<uint8_t> bytes(4*image.words.size());
+    for(unsigned i=0; i<image.words.size(); i++){
+        bytes[4*i+0]=image.words[i]>>24;
+        bytes[4*i+1]=image.words[i]>>16;
+        bytes[4*i+2]=image.words[i]>>8;
+        bytes[4*i+3]=image.words[i];
+    }
+
+    fprintf(dst, "/* Translated from %s by mips_aot_translate. Do not edit. */\n", sourceName);
+    fprintf(dst, "%s", sg_prologue);
+
+    fprintf(dst, "static const uint32_t aot_blocks[]={\n");
+    for(std::set<uint32_t>::const_iterator it=leaders.begin(); it!=leaders.end(); ++it){
+        fprintf(dst, "    0x%08xu,\n", *it);
+    }
+    fprintf(dst, "    0\n};\n\n");
+
+    fprintf(dst,
+        "static int aot_known(uint32_t pc)\n"
+        "{\n"
+        "    unsigned lo=0, hi=%u;\n"
+        "    while(lo<hi){\n"
+        "        unsigned mid=(lo+hi)/2;\n"
+        "        if(aot_blocks[mid]<pc){ lo=mid+1; }else{ hi=mid; }\n"
+        "    }\n"
+        "    return lo<%u && aot_blocks[lo]==pc;\n"
+        "}\n\n", (unsigned)leaders.size(), (unsigned)leaders.size());
+
+    fprintf(dst,
+        "static mips_error aot_run(const mips_aot_env *env, mips_cpu_h cpu, mips_mem_h mem,\n"
+        "    uint32_t haltPc, uint64_t maxSteps, uint64_t *stepsInOut, int *interpret)\n"
+        "{\n"
+        "    uint32_t r[32], pc, target=0;\n"
+        "    int taken=0;\n"
+        "    uint64_t steps=*stepsInOut;\n"
+        "    uint64_t limit = maxSteps ? maxSteps : ~(uint64_t)0;\n"
+        "    mips_error err=mips_Success;\n"
+        "    *interpret=0;\n"
+        "    for(unsigned i=0; i<32 && !err; i++){\n"
+        "        err=env->cpu_get_register(cpu, i, &r[i]);\n"
+        "    }\n"
+        "    if(!err){\n"
+        "        err=env->cpu_get_pc(cpu, &pc);\n"
+        "    }\n"
+        "    if(err){\n"
+        "        return err;\n"
+        "    }\n"
+        "\n"
+        "dispatch:\n"
+        "    if(pc==haltPc || steps>=limit){\n"
+        "        goto leave;\n"
+        "    }\n"
+        "    switch(pc){\n");
+    for(std::set<uint32_t>::const_iterator it=leaders.begin(); it!=leaders.end(); ++it){
+        fprintf(dst, "    case 0x%08xu: goto L_%08x;\n", *it, *it);
+    }
+    fprintf(dst,
+        "    default: goto fallback;\n"
+        "    }\n\n");
+
+    for(uint32_t pc=image.base; pc<image.end(); pc+=4){
+        uint32_t instr=image.at(pc);
+        const mips_isa_info *info=aot_info(instr);
+        if(leaders.count(pc)){
+            fprintf(dst, "L_%08x:\n", pc);
+        }
+        fprintf(dst, "    // 0x%08x: %08x %s\n", pc, instr, info ? info->name : "?");
+
+        /* Stop exactly at the halt pc, wherever it is. A halt pc in a
+           delay slot has to be left to the CPU, as only it can hold the
+           branch while stopped there. */
+        std::string halt=aot_format("    if(haltPc==0x%08xu){ pc=0x%08xu; goto leave; }\n", pc, pc);
+        if(aot_is_control(instr)){
+            halt+=aot_format("    if(haltPc==0x%08xu){ pc=0x%08xu; goto fallback; }\n", pc+4, pc);
+        }
+        std::string code;
+        bool ok = aot_is_control(instr) ? aot_control(image, leaders, pc, code) : aot_simple(pc, instr, code);
+        if(ok && !aot_is_control(instr)){
+            code+="    steps++;\n";
+        }
+        if(!ok){
+            code=aot_format("    pc=0x%08xu; goto fallback;\n", pc);
+        }
+        fprintf(dst, "%s%s", halt.c_str(), code.c_str());
+    }
+
+    fprintf(dst,
+        "    pc=0x%08xu;\n"
+        "    goto dispatch;\n"
+        "\n"
+        "fallback:\n"
+        "    *interpret=1;\n"
+        "leave:\n"
+        "    for(unsigned i=1; i<32; i++){\n"
+        "        mips_error e=env->cpu_set_register(cpu, i, r[i]);\n"
+        "        err = err ? err : e;\n"
+        "    }\n"
+        "    {\n"
+        "        mips_error e=env->cpu_set_pc(cpu, pc);\n"
+        "        err = err ? err : e;\n"
+        "    }\n"
+        "    *stepsInOut=steps;\n"
+        "    (void)target; (void)taken; (void)mem;\n"
+        "    return err;\n"
+        "}\n\n", image.end());
+
+    fprintf(dst,
+        "extern \"C\" const mips_aot_module mips_aot_exports={\n"
+        "    MIPS_AOT_VERSION, 0x%08xu, 0x%08xu, 0x%016llxull, aot_run, aot_known\n"
+        "};\n",
+        image.base, (unsigned)bytes.size(),
+        (unsigned long long)mips_aot_hash(bytes.empty() ? 0 : &bytes[0], bytes.size()));
+}
+
+extern "C" mips_error mips_aot_translate(
+    FILE *dst,
+    const char *sourceName,
+    uint32_t base,
+    const uint8_t *data,
+    uint32_t length,
+    unsigned entryCount,
+    const uint32_t *entries
+){
+    if(dst==0 || sourceName==0 || (base&3) || (length>0 && data==0) || (entryCount>0 && entries==0)){
+        return mips_ErrorInvalidArgument;
+    }
+
+    aot_image_t image;
+    image.base=base;
+    for(uint32_t i=0; i<length; i+=4){
+        uint8_t bytes[4]={0, 0, 0, 0};
+        memcpy(bytes, data+i, length-i < 4 ? length-i : 4);
+        image.words.push_back((bytes[0]<<24) | (bytes[1]<<16) | (bytes[2]<<8) | bytes[3]);
+    }
+
+    std::vector<uint32_t> starts(entries, entries+entryCount);
+    starts.push_back(base);
+    aot_write(dst, sourceName, image, starts);
+    return ferror(dst) ? mips_ErrorFileWriteError : mips_Success;
+}
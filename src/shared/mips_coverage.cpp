@@ -0,0 +1,308 @@
+/* This file is an implementation of the functions
+   defined in mips_coverage.h. It only uses the public
+   CPU and memory APIs, plus the instruction descriptions
+   from mips_isa.h.
+*/
+#include "mips_coverage.h"
+#include "mips_isa.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <string.h>
+
+// Number of outcome bits per instruction, of which COV_OUTCOME_COUNT are used
+#define COV_OUTCOMES        16
+#define COV_OUTCOME_COUNT   9
+
+// Raw encoding slots: primary opcode, then SPECIAL funct, then REGIMM rt
+#define COV_ENCODINGS   (64+64+32)
+
+static const char *sg_outcomeNames[COV_OUTCOME_COUNT]={
+    "ok", "Break", "Length", "Address", "Alignment", "Access", "Instruction", "Overflow", "Error"
+};
+
+static const char sg_fileMagic[8]={'M','I','P','S','C','O','V','1'};
+
+/* The bitmap is one array of words, split into sections:
+
+       outcomes    [slot][outcome]
+       encodings   [encoding slot]
+       fields      [slot][rs/rt/rd][register]
+       pcs         [word]
+
+   where slot is the mips_isa index, or mips_isa_count() for an
+   encoding that isn't a described instruction. */
+struct mips_coverage_impl
+{
+    uint32_t pcBase;
+    uint32_t pcLength;
+
+    unsigned slots;
+    uint32_t outcomeBase, encodingBase, fieldBase, pcBitBase, bitCount;
+    std::vector<uint64_t> bits;
+};
+
+static void cov_set(mips_coverage_h cov, uint32_t bit)
+{
+    cov->bits[bit>>6] |= 1ull<<(bit&63);
+}
+
+static bool cov_get(mips_coverage_h cov, uint32_t bit)
+{
+    return (cov->bits[bit>>6]>>(bit&63)) & 1;
+}
+
+static unsigned cov_outcome(mips_error err)
+{
+    if(err==mips_Success){
+        return 0;
+    }
+    if(err>=mips_ExceptionBreak && err<=mips_ExceptionArithmeticOverflow){
+        return 1+(err-mips_ExceptionBreak);
+    }
+    return COV_OUTCOME_COUNT-1;
+}
+
+static unsigned cov_encoding_slot(uint32_t instruction)
+{
+    uint32_t opcode=instruction>>26;
+    if(opcode==0){
+        return 64+(instruction&0x3F);
+    }else if(opcode==1){
+        return 128+((instruction>>16)&0x1F);
+    }
+    return opcode;
+}
+
+/* Which of rs, rt and rd (bits 0, 1, 2) hold registers. The operand
+   masks overlap, as the immediate covers rd and the jump target covers
+   all three, so a field doesn't count if a wider field uses its bits. */
+static unsigned cov_register_fields(const mips_isa_info *info)
+{
+    uint32_t operands=info->operands;
+    if((info->flags & mips_isa_Jump) && operands==MIPS_ISA_TARGET){
+        return 0;
+    }
+    unsigned res=0;
+    if(operands & MIPS_ISA_RS){
+        res|=1;
+    }
+    if(operands & MIPS_ISA_RT){
+        res|=2;
+    }
+    if((operands & MIPS_ISA_RD) && (operands & MIPS_ISA_IMMEDIATE)!=MIPS_ISA_IMMEDIATE){
+        res|=4;
+    }
+    return res;
+}
+
+extern "C" mips_coverage_h mips_coverage_create(uint32_t pcBase, uint32_t pcLength)
+{
+    mips_coverage_h cov=new mips_coverage_impl;
+    cov->pcBase=pcBase;
+    cov->pcLength=pcLength;
+    cov->slots=mips_isa_count()+1;
+    cov->outcomeBase=0;
+    cov->encodingBase=cov->outcomeBase+cov->slots*COV_OUTCOMES;
+    cov->fieldBase=cov->encodingBase+COV_ENCODINGS;
+    cov->pcBitBase=cov->fieldBase+cov->slots*3*32;
+    cov->bitCount=cov->pcBitBase+(pcLength+3)/4;
+    cov->bits.resize((cov->bitCount+63)/64);
+    return cov;
+}
+
+static void cov_record(mips_coverage_h cov, uint32_t pc, bool fetched, uint32_t instruction, mips_error err)
+{
+    unsigned slot=cov->slots-1;
+    if(fetched){
+        int index=mips_isa_decode(instruction);
+        if(index>=0){
+            slot=index;
+        }
+        cov_set(cov, cov->encodingBase+cov_encoding_slot(instruction));
+
+        if(index>=0){
+            unsigned used=cov_register_fields(mips_isa_get(index));
+            uint32_t fields=cov->fieldBase+slot*3*32;
+            if(used & 1){
+                cov_set(cov, fields+((instruction>>21)&0x1F));
+            }
+            if(used & 2){
+                cov_set(cov, fields+32+((instruction>>16)&0x1F));
+            }
+            if(used & 4){
+                cov_set(cov, fields+64+((instruction>>11)&0x1F));
+            }
+        }
+    }
+    cov_set(cov, cov->outcomeBase+slot*COV_OUTCOMES+cov_outcome(err));
+
+    if(pc-cov->pcBase < cov->pcLength){
+        cov_set(cov, cov->pcBitBase+(pc-cov->pcBase)/4);
+    }
+}
+
+extern "C" void mips_coverage_record(mips_coverage_h cov, uint32_t pc, uint32_t instruction, mips_error err)
+{
+    cov_record(cov, pc, true, instruction, err);
+}
+
+extern "C" mips_error mips_coverage_step(mips_coverage_h cov, mips_cpu_h cpu, mips_mem_h mem)
+{
+    uint32_t pc=0;
+    uint8_t bytes[4];
+    bool fetched = !mips_cpu_get_pc(cpu, &pc) && !mips_mem_read(mem, pc, 4, bytes);
+
+    mips_error err=mips_cpu_step(cpu);
+
+    uint32_t instruction = fetched ? (bytes[0]<<24) | (bytes[1]<<16) | (bytes[2]<<8) | bytes[3] : 0;
+    cov_record(cov, pc, fetched, instruction, err);
+    return err;
+}
+
+extern "C" mips_error mips_coverage_merge(mips_coverage_h dst, mips_coverage_h src)
+{
+    if(dst==0 || src==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(dst->pcBase!=src->pcBase || dst->pcLength!=src->pcLength){
+        return mips_ErrorInvalidArgument;
+    }
+    for(unsigned i=0; i<dst->bits.size(); i++){
+        dst->bits[i]|=src->bits[i];
+    }
+    return mips_Success;
+}
+
+extern "C" void mips_coverage_clear(mips_coverage_h cov)
+{
+    std::fill(cov->bits.begin(), cov->bits.end(), 0);
+}
+
+/* The file is the magic, then the layout, then the words in host order. */
+static void cov_header(mips_coverage_h cov, uint32_t header[4])
+{
+    header[0]=cov->slots;
+    header[1]=cov->pcBase;
+    header[2]=cov->pcLength;
+    header[3]=cov->bits.size();
+}
+
+extern "C" mips_error mips_coverage_save(mips_coverage_h cov, const char *path)
+{
+    if(cov==0){
+        return mips_ErrorInvalidHandle;
+    }
+    FILE *dst=fopen(path, "wb");
+    if(!dst){
+        return mips_ErrorFileWriteError;
+    }
+    uint32_t header[4];
+    cov_header(cov, header);
+    bool ok = 1==fwrite(sg_fileMagic, sizeof(sg_fileMagic), 1, dst)
+        && 1==fwrite(header, sizeof(header), 1, dst)
+        && cov->bits.size()==fwrite(&cov->bits[0], sizeof(uint64_t), cov->bits.size(), dst);
+    ok = (0==fclose(dst)) && ok;
+    return ok ? mips_Success : mips_ErrorFileWriteError;
+}
+
+extern "C" mips_error mips_coverage_load(mips_coverage_h cov, const char *path)
+{
+    if(cov==0){
+        return mips_ErrorInvalidHandle;
+    }
+    FILE *src=fopen(path, "rb");
+    if(!src){
+        return mips_Success;    // Nothing recorded yet
+    }
+    char magic[sizeof(sg_fileMagic)];
+    uint32_t header[4], expected[4];
+    cov_header(cov, expected);
+    std::vector<uint64_t> bits(cov->bits.size());
+    bool ok = 1==fread(magic, sizeof(magic), 1, src)
+        && !memcmp(magic, sg_fileMagic, sizeof(magic))
+        && 1==fread(header, sizeof(header), 1, src)
+        && !memcmp(header, expected, sizeof(header))
+        && bits.size()==fread(&bits[0], sizeof(uint64_t), bits.size(), src);
+    fclose(src);
+    if(!ok){
+        return mips_ErrorFileReadError;
+    }
+    for(unsigned i=0; i<bits.size(); i++){
+        cov->bits[i]|=bits[i];
+    }
+    return mips_Success;
+}
+
+static unsigned cov_count(mips_coverage_h cov, uint32_t begin, uint32_t length)
+{
+    unsigned n=0;
+    for(uint32_t i=0; i<length; i++){
+        n+=cov_get(cov, begin+i);
+    }
+    return n;
+}
+
+extern "C" void mips_coverage_report(mips_coverage_h cov, FILE *dst)
+{
+    unsigned executed=0, known=cov->slots-1;
+
+    fprintf(dst, "| Instruction | outcomes                       |   rs  |   rt  |   rd  |\n");
+    fprintf(dst, "+-------------+--------------------------------+-------+-------+-------+\n");
+    for(unsigned slot=0; slot<cov->slots; slot++){
+        uint32_t outcomes=cov->outcomeBase+slot*COV_OUTCOMES;
+        std::string seen;
+        for(unsigned i=0; i<COV_OUTCOME_COUNT; i++){
+            if(cov_get(cov, outcomes+i)){
+                seen+=seen.empty() ? "" : " ";
+                seen+=sg_outcomeNames[i];
+            }
+        }
+        if(slot==known && seen.empty()){
+            continue;   // Only worth a row if something unknown was run
+        }
+        if(slot<known && !seen.empty()){
+            executed++;
+        }
+
+        const char *name = slot<known ? mips_isa_get(slot)->name : "<UNKNOWN>";
+        fprintf(dst, "|%12s | %-30s |", name, seen.empty() ? "-- never executed --" : seen.c_str());
+
+        unsigned used = slot<known ? cov_register_fields(mips_isa_get(slot)) : 0;
+        for(unsigned f=0; f<3; f++){
+            if(used & (1<<f)){
+                fprintf(dst, " %2u/32 |", cov_count(cov, cov->fieldBase+(slot*3+f)*32, 32));
+            }else{
+                fprintf(dst, "     - |");
+            }
+        }
+        fprintf(dst, "\n");
+    }
+    fprintf(dst, "+-------------+--------------------------------+-------+-------+-------+\n");
+    fprintf(dst, "%u of %u instructions executed (%.1f%%).\n", executed, known, 100.0*executed/known);
+
+    // Encodings seen that aren't any described instruction
+    for(unsigned i=0; i<COV_ENCODINGS; i++){
+        if(!cov_get(cov, cov->encodingBase+i)){
+            continue;
+        }
+        uint32_t instruction = i<64 ? i<<26 : i<128 ? (i-64) : (1u<<26) | ((i-128)<<16);
+        if(mips_isa_decode(instruction)<0){
+            const char *kind = i<64 ? "opcode" : i<128 ? "SPECIAL funct" : "REGIMM rt";
+            fprintf(dst, "Unknown encoding executed: %s 0x%02x\n", kind, i<64 ? i : i<128 ? i-64 : i-128);
+        }
+    }
+
+    if(cov->pcLength){
+        unsigned words=(cov->pcLength+3)/4;
+        unsigned hit=cov_count(cov, cov->pcBitBase, words);
+        fprintf(dst, "%u of %u words executed in pc range 0x%08x..0x%08x.\n",
+            hit, words, cov->pcBase, cov->pcBase+cov->pcLength-1);
+    }
+}
+
+extern "C" void mips_coverage_free(mips_coverage_h cov)
+{
+    delete cov;
+}
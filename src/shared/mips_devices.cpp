@@ -0,0 +1,133 @@
+/* This file is an implementation of the functions
+   defined in mips_devices.h. The devices are plugged
+   into memories through mips_mem_map_device, so they
+   work with any memory implementation that supports it.
+*/
+#include "mips_devices.h"
+
+#include <vector>
+#include <mutex>
+
+#define CONSOLE_DEFAULT_BUFFER 4096
+
+struct mips_console_impl
+{
+    FILE *dst;
+    bool lineBuffered;
+    uint32_t bufferSize;
+
+    std::mutex mutex;
+    std::vector<char> buffer;
+};
+
+/* Must be called with the mutex held. */
+static void console_write_out(mips_console_h con)
+{
+    if(!con->buffer.empty()){
+        fwrite(&con->buffer[0], 1, con->buffer.size(), con->dst);
+        fflush(con->dst);
+        con->buffer.clear();
+    }
+}
+
+static mips_error console_access(void *param, int write, uint32_t offset, uint32_t length, uint8_t *data)
+{
+    mips_console_h con=(mips_console_h)param;
+    if(!write){
+        for(uint32_t i=0; i<length; i++){
+            data[i]=0;
+        }
+        return mips_Success;
+    }
+
+    // Whatever the size of the write, the character is the least significant byte
+    char c=(char)data[length-1];
+    (void)offset;
+
+    std::lock_guard<std::mutex> lock(con->mutex);
+    con->buffer.push_back(c);
+    if(con->buffer.size()>=con->bufferSize || (c=='\n' && con->lineBuffered)){
+        console_write_out(con);
+    }
+    return mips_Success;
+}
+
+extern "C" mips_console_h mips_console_create(FILE *dst, uint32_t bufferSize, int lineBuffered)
+{
+    if(dst==0){
+        return 0;
+    }
+    mips_console_h con=new mips_console_impl;
+    con->dst=dst;
+    con->lineBuffered=lineBuffered!=0;
+    con->bufferSize = bufferSize ? bufferSize : CONSOLE_DEFAULT_BUFFER;
+    con->buffer.reserve(con->bufferSize);
+    return con;
+}
+
+extern "C" mips_error mips_console_attach(mips_console_h con, mips_mem_h mem, uint32_t address)
+{
+    if(con==0){
+        return mips_ErrorInvalidHandle;
+    }
+    return mips_mem_map_device(mem, address, 4, console_access, con);
+}
+
+extern "C" void mips_console_flush(mips_console_h con)
+{
+    if(con){
+        std::lock_guard<std::mutex> lock(con->mutex);
+        console_write_out(con);
+    }
+}
+
+extern "C" void mips_console_free(mips_console_h con)
+{
+    if(con){
+        mips_console_flush(con);
+        delete con;
+    }
+}
+
+struct mips_timer_impl
+{
+    const uint64_t *retired;
+};
+
+static mips_error timer_access(void *param, int write, uint32_t offset, uint32_t length, uint8_t *data)
+{
+    if(write){
+        return mips_ExceptionAccessViolation;
+    }
+    mips_timer_h timer=(mips_timer_h)param;
+    uint64_t count=__atomic_load_n(timer->retired, __ATOMIC_RELAXED);
+
+    // The count as 8 big-endian bytes, of which the transaction picks some out
+    for(uint32_t i=0; i<length; i++){
+        data[i]=(uint8_t)(count>>(8*(7-(offset+i))));
+    }
+    return mips_Success;
+}
+
+extern "C" mips_timer_h mips_timer_create(const uint64_t *retired)
+{
+    if(retired==0){
+        return 0;
+    }
+    mips_timer_h timer=new mips_timer_impl;
+    timer->retired=retired;
+    return timer;
+}
+
+extern "C" mips_error mips_timer_attach(mips_timer_h timer, mips_mem_h mem, uint32_t address)
+{
+    if(timer==0){
+        return mips_ErrorInvalidHandle;
+    }
+    return mips_mem_map_device(mem, address, 8, timer_access, timer);
+}
+
+extern "C" void mips_timer_free(mips_timer_h timer)
+{
+    delete timer;
+}
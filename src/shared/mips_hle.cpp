@@ -0,0 +1,235 @@
+/* This file is an implementation of the functions
+   defined in mips_hle.h. It only uses the public
+   CPU and memory APIs.
+*/
+#include "mips_hle.h"
+
+#include <vector>
+#include <algorithm>
+
+struct hle_hook_t
+{
+    uint32_t address;
+    mips_hle_fn fn;
+    void *param;
+    uint64_t steps;
+
+    bool operator<(uint32_t pc) const
+    { return address<pc; }
+};
+
+struct mips_hle_impl
+{
+    std::vector<hle_hook_t> hooks;  // Sorted by address
+};
+
+static const hle_hook_t *hle_find(mips_hle_h hle, uint32_t pc)
+{
+    std::vector<hle_hook_t>::const_iterator it=std::lower_bound(hle->hooks.begin(), hle->hooks.end(), pc);
+    if(it==hle->hooks.end() || it->address!=pc){
+        return 0;
+    }
+    return &*it;
+}
+
+extern "C" mips_hle_h mips_hle_create()
+{
+    return new mips_hle_impl;
+}
+
+extern "C" mips_error mips_hle_add(mips_hle_h hle, uint32_t address, mips_hle_fn fn, void *param, uint64_t steps)
+{
+    if(hle==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(fn==0 || (address&3)){
+        return mips_ErrorInvalidArgument;
+    }
+    hle_hook_t hook={address, fn, param, steps};
+    std::vector<hle_hook_t>::iterator it=std::lower_bound(hle->hooks.begin(), hle->hooks.end(), address);
+    if(it!=hle->hooks.end() && it->address==address){
+        *it=hook;
+    }else{
+        hle->hooks.insert(it, hook);
+    }
+    return mips_Success;
+}
+
+extern "C" int mips_hle_is_hooked(mips_hle_h hle, uint32_t address)
+{
+    return hle && hle_find(hle, address)!=0;
+}
+
+extern "C" mips_error mips_hle_step(mips_hle_h hle, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps)
+{
+    if(hle==0 || cpu==0 || mem==0){
+        return mips_ErrorInvalidHandle;
+    }
+
+    if(steps){
+        *steps=0;
+    }
+    uint32_t pc;
+    mips_error err=mips_cpu_get_pc(cpu, &pc);
+    if(err){
+        return err;
+    }
+    const hle_hook_t *hook = hle->hooks.empty() ? 0 : hle_find(hle, pc);
+    if(!hook){
+        err=mips_cpu_step(cpu);
+        if(steps){
+            *steps = err ? 0 : 1;
+        }
+        return err;
+    }
+
+    uint64_t count=hook->steps;
+    uint32_t ra=0;
+    err=hook->fn(hook->param, cpu, mem, &count);
+    if(!err){
+        err=mips_cpu_get_register(cpu, 31, &ra);
+    }
+    if(!err){
+        err=mips_cpu_set_pc(cpu, ra);
+    }
+    if(steps){
+        *steps = err ? 0 : count;
+    }
+    return err;
+}
+
+extern "C" mips_error mips_hle_run(
+    mips_hle_h hle,
+    mips_cpu_h cpu,
+    mips_mem_h mem,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    uint64_t *steps
+){
+    if(hle==0 || cpu==0 || mem==0){
+        return mips_ErrorInvalidHandle;
+    }
+
+    uint64_t count=0;
+    uint32_t pc;
+    mips_error err=mips_cpu_get_pc(cpu, &pc);
+    while(!err && pc!=haltPc && !(maxSteps && count>=maxSteps)){
+        uint64_t n;
+        err=mips_hle_step(hle, cpu, mem, &n);
+        if(err){
+            break;
+        }
+        count+=n;
+        err=mips_cpu_get_pc(cpu, &pc);
+    }
+    if(steps){
+        *steps=count;
+    }
+    return err;
+}
+
+extern "C" mips_error mips_hle_get_arg(mips_cpu_h cpu, mips_mem_h mem, unsigned index, uint32_t *value)
+{
+    if(index<4){
+        return mips_cpu_get_register(cpu, 4+index, value);
+    }
+
+    // The caller reserves 16 bytes for $a0-$a3, so argument i is at 4*i($sp)
+    uint32_t sp;
+    mips_error err=mips_cpu_get_register(cpu, 29, &sp);
+    if(err){
+        return err;
+    }
+    uint8_t bytes[4];
+    err=mips_mem_read(mem, sp+4*index, 4, bytes);
+    if(!err){
+        *value=(bytes[0]<<24) | (bytes[1]<<16) | (bytes[2]<<8) | bytes[3];
+    }
+    return err;
+}
+
+extern "C" mips_error mips_hle_set_result(mips_cpu_h cpu, uint32_t v0, uint32_t v1)
+{
+    mips_error err=mips_cpu_set_register(cpu, 2, v0);
+    if(!err){
+        err=mips_cpu_set_register(cpu, 3, v1);
+    }
+    return err;
+}
+
+/* Reads the first three arguments, which is all the built-in hooks take. */
+static mips_error hle_get_args(mips_cpu_h cpu, mips_mem_h mem, uint32_t *a0, uint32_t *a1, uint32_t *a2)
+{
+    mips_error err=mips_hle_get_arg(cpu, mem, 0, a0);
+    if(!err){
+        err=mips_hle_get_arg(cpu, mem, 1, a1);
+    }
+    if(!err){
+        err=mips_hle_get_arg(cpu, mem, 2, a2);
+    }
+    return err;
+}
+
+/* Adds the per-word rate (if any) for n bytes to the count of a call. */
+static void hle_charge(void *param, uint32_t n, uint64_t *steps)
+{
+    if(param){
+        *steps+=(uint64_t)*(const uint32_t*)param * (((uint64_t)n+3)/4);
+    }
+}
+
+extern "C" mips_error mips_hle_memcpy(void *param, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps)
+{
+    uint32_t dst=0, src=0, n=0;
+    mips_error err=hle_get_args(cpu, mem, &dst, &src, &n);
+    if(err){
+        return err;
+    }
+    hle_charge(param, n, steps);
+
+    uint32_t d=dst;
+    while(n>0){
+        // Words where both sides allow it, as memory only takes aligned transactions
+        uint32_t length = (n>=4 && ((d|src)&3)==0) ? 4 : 1;
+        uint8_t bytes[4];
+        err=mips_mem_read(mem, src, length, bytes);
+        if(!err){
+            err=mips_mem_write(mem, d, length, bytes);
+        }
+        if(err){
+            return err;
+        }
+        d+=length;
+        src+=length;
+        n-=length;
+    }
+    return mips_hle_set_result(cpu, dst, 0);
+}
+
+extern "C" mips_error mips_hle_memset(void *param, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps)
+{
+    uint32_t dst=0, c=0, n=0;
+    mips_error err=hle_get_args(cpu, mem, &dst, &c, &n);
+    if(err){
+        return err;
+    }
+    hle_charge(param, n, steps);
+
+    uint8_t bytes[4]={(uint8_t)c, (uint8_t)c, (uint8_t)c, (uint8_t)c};
+    uint32_t d=dst;
+    while(n>0){
+        uint32_t length = (n>=4 && (d&3)==0) ? 4 : 1;
+        err=mips_mem_write(mem, d, length, bytes);
+        if(err){
+            return err;
+        }
+        d+=length;
+        n-=length;
+    }
+    return mips_hle_set_result(cpu, dst, 0);
+}
+
+extern "C" void mips_hle_free(mips_hle_h hle)
+{
+    delete hle;
+}
@@ -0,0 +1,134 @@
+/* This file is an implementation of the functions
+   defined in mips_isa.h. It doesn't depend on any
+   other part of the simulator.
+*/
+#include "mips_isa.h"
+
+// Masks for the three ways that instructions are identified
+#define ISA_OPCODE  0xFC000000u     // Opcode alone
+#define ISA_SPECIAL 0xFC00003Fu     // Opcode 0, plus the funct field
+#define ISA_REGIMM  0xFC1F0000u     // Opcode 1, plus the rt field
+
+#define ISA_OP(op)      ((uint32_t)(op)<<26)
+#define ISA_FN(fn)      ((uint32_t)(fn))
+#define ISA_RI(rt)      (ISA_OP(1) | ((uint32_t)(rt)<<16))
+
+#define ISA_R3      (MIPS_ISA_RS | MIPS_ISA_RT | MIPS_ISA_RD)
+#define ISA_SHIFT   (MIPS_ISA_RT | MIPS_ISA_RD | MIPS_ISA_SHAMT)
+#define ISA_IMM     (MIPS_ISA_RS | MIPS_ISA_RT | MIPS_ISA_IMMEDIATE)
+#define ISA_BR1     (MIPS_ISA_RS | MIPS_ISA_IMMEDIATE)
+
+static const mips_isa_info sg_isaArray[]=
+{
+    {"ADD",     ISA_FN(0x20),   ISA_SPECIAL,    ISA_R3,     mips_isa_Overflow,  0},
+    {"ADDI",    ISA_OP(0x08),   ISA_OPCODE,     ISA_IMM,    mips_isa_Overflow,  0},
+    {"ADDIU",   ISA_OP(0x09),   ISA_OPCODE,     ISA_IMM,    0,  0},
+    {"ADDU",    ISA_FN(0x21),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"AND",     ISA_FN(0x24),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"ANDI",    ISA_OP(0x0C),   ISA_OPCODE,     ISA_IMM,    0,  0},
+    {"BEQ",     ISA_OP(0x04),   ISA_OPCODE,     ISA_IMM,    mips_isa_Branch,    0},
+    {"BGEZ",    ISA_RI(0x01),   ISA_REGIMM,     ISA_BR1,    mips_isa_Branch,    0},
+    {"BGEZAL",  ISA_RI(0x11),   ISA_REGIMM,     ISA_BR1,    mips_isa_Branch | mips_isa_Link,    0},
+    {"BGTZ",    ISA_OP(0x07),   ISA_OPCODE,     ISA_BR1,    mips_isa_Branch,    0},
+    {"BLEZ",    ISA_OP(0x06),   ISA_OPCODE,     ISA_BR1,    mips_isa_Branch,    0},
+    {"BLTZ",    ISA_RI(0x00),   ISA_REGIMM,     ISA_BR1,    mips_isa_Branch,    0},
+    {"BLTZAL",  ISA_RI(0x10),   ISA_REGIMM,     ISA_BR1,    mips_isa_Branch | mips_isa_Link,    0},
+    {"BNE",     ISA_OP(0x05),   ISA_OPCODE,     ISA_IMM,    mips_isa_Branch,    0},
+    {"DIV",     ISA_FN(0x1A),   ISA_SPECIAL,    MIPS_ISA_RS | MIPS_ISA_RT,  mips_isa_WritesHiLo,    0},
+    {"DIVU",    ISA_FN(0x1B),   ISA_SPECIAL,    MIPS_ISA_RS | MIPS_ISA_RT,  mips_isa_WritesHiLo,    0},
+    {"J",       ISA_OP(0x02),   ISA_OPCODE,     MIPS_ISA_TARGET,    mips_isa_Jump,  0},
+    {"JAL",     ISA_OP(0x03),   ISA_OPCODE,     MIPS_ISA_TARGET,    mips_isa_Jump | mips_isa_Link,  0},
+    {"JALR",    ISA_FN(0x09),   ISA_SPECIAL,    MIPS_ISA_RS | MIPS_ISA_RD,  mips_isa_Jump | mips_isa_Link,  0},
+    {"JR",      ISA_FN(0x08),   ISA_SPECIAL,    MIPS_ISA_RS,    mips_isa_Jump,  0},
+    {"LB",      ISA_OP(0x20),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  1},
+    {"LBU",     ISA_OP(0x24),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  1},
+    {"LH",      ISA_OP(0x21),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  2},
+    {"LHU",     ISA_OP(0x25),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  2},
+    {"LUI",     ISA_OP(0x0F),   ISA_OPCODE,     MIPS_ISA_RT | MIPS_ISA_IMMEDIATE,   0,  0},
+    {"LW",      ISA_OP(0x23),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  4},
+    {"LWL",     ISA_OP(0x22),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  4},
+    {"LWR",     ISA_OP(0x26),   ISA_OPCODE,     ISA_IMM,    mips_isa_Load,  4},
+    {"MFHI",    ISA_FN(0x10),   ISA_SPECIAL,    MIPS_ISA_RD,    mips_isa_ReadsHiLo, 0},
+    {"MFLO",    ISA_FN(0x12),   ISA_SPECIAL,    MIPS_ISA_RD,    mips_isa_ReadsHiLo, 0},
+    {"MTHI",    ISA_FN(0x11),   ISA_SPECIAL,    MIPS_ISA_RS,    mips_isa_WritesHiLo,    0},
+    {"MTLO",    ISA_FN(0x13),   ISA_SPECIAL,    MIPS_ISA_RS,    mips_isa_WritesHiLo,    0},
+    {"MULT",    ISA_FN(0x18),   ISA_SPECIAL,    MIPS_ISA_RS | MIPS_ISA_RT,  mips_isa_WritesHiLo,    0},
+    {"MULTU",   ISA_FN(0x19),   ISA_SPECIAL,    MIPS_ISA_RS | MIPS_ISA_RT,  mips_isa_WritesHiLo,    0},
+    {"OR",      ISA_FN(0x25),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"ORI",     ISA_OP(0x0D),   ISA_OPCODE,     ISA_IMM,    0,  0},
+    {"SB",      ISA_OP(0x28),   ISA_OPCODE,     ISA_IMM,    mips_isa_Store, 1},
+    {"SH",      ISA_OP(0x29),   ISA_OPCODE,     ISA_IMM,    mips_isa_Store, 2},
+    {"SLL",     ISA_FN(0x00),   ISA_SPECIAL,    ISA_SHIFT,  0,  0},
+    {"SLLV",    ISA_FN(0x04),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"SLT",     ISA_FN(0x2A),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"SLTI",    ISA_OP(0x0A),   ISA_OPCODE,     ISA_IMM,    0,  0},
+    {"SLTIU",   ISA_OP(0x0B),   ISA_OPCODE,     ISA_IMM,    0,  0},
+    {"SLTU",    ISA_FN(0x2B),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"SRA",     ISA_FN(0x03),   ISA_SPECIAL,    ISA_SHIFT,  0,  0},
+    {"SRAV",    ISA_FN(0x07),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"SRL",     ISA_FN(0x02),   ISA_SPECIAL,    ISA_SHIFT,  0,  0},
+    {"SRLV",    ISA_FN(0x06),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"SUB",     ISA_FN(0x22),   ISA_SPECIAL,    ISA_R3,     mips_isa_Overflow,  0},
+    {"SUBU",    ISA_FN(0x23),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"SW",      ISA_OP(0x2B),   ISA_OPCODE,     ISA_IMM,    mips_isa_Store, 4},
+    {"XOR",     ISA_FN(0x26),   ISA_SPECIAL,    ISA_R3,     0,  0},
+    {"XORI",    ISA_OP(0x0E),   ISA_OPCODE,     ISA_IMM,    0,  0}
+};
+static const unsigned sg_isaCount = sizeof(sg_isaArray)/sizeof(sg_isaArray[0]);
+
+/* Lookup tables from the identifying field to an index, built the
+   first time they are needed. -1 means no instruction. */
+struct isa_tables_t
+{
+    int opcode[64];
+    int special[64];
+    int regimm[32];
+
+    isa_tables_t()
+    {
+        for(unsigned i=0; i<64; i++){
+            opcode[i]=-1;
+            special[i]=-1;
+        }
+        for(unsigned i=0; i<32; i++){
+            regimm[i]=-1;
+        }
+        for(unsigned i=0; i<sg_isaCount; i++){
+            const mips_isa_info &info=sg_isaArray[i];
+            if(info.mask==ISA_SPECIAL){
+                special[info.match&0x3F]=i;
+            }else if(info.mask==ISA_REGIMM){
+                regimm[(info.match>>16)&0x1F]=i;
+            }else{
+                opcode[info.match>>26]=i;
+            }
+        }
+    }
+};
+
+extern "C" unsigned mips_isa_count()
+{
+    return sg_isaCount;
+}
+
+extern "C" const mips_isa_info *mips_isa_get(unsigned index)
+{
+    if(index>=sg_isaCount){
+        return 0;
+    }
+    return &sg_isaArray[index];
+}
+
+extern "C" int mips_isa_decode(uint32_t encoding)
+{
+    static const isa_tables_t tables;
+
+    uint32_t opcode=encoding>>26;
+    if(opcode==0){
+        return tables.special[encoding&0x3F];
+    }else if(opcode==1){
+        return tables.regimm[(encoding>>16)&0x1F];
+    }else{
+        return tables.opcode[opcode];
+    }
+}
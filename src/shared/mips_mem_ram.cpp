@@ -8,13 +8,94 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/* RAMs at least this big are mapped directly from the OS, so that
+   they cost nothing until touched, and can be handed back in one go. */
+#define RAM_MAP_THRESHOLD	(256*1024u)
+
+/* Resetting a mapped RAM with this many touched pages gives the whole
+   mapping back to the OS, rather than clearing the pages one by one. */
+#define RAM_DISCARD_PAGES	256u
+
+// Per-page flags
+#define RAM_DIRTY	1	// Written since the dirty set was last cleared
+#define RAM_TOUCHED	2	// Written since the RAM was created or reset
+
+struct mips_mem_device
+{
+	uint32_t base;
+	uint32_t length;
+	mips_mem_device_fn fn;
+	void *param;
+};
 
 struct mips_mem_provider
 {
 	uint32_t length;
 	uint8_t *data;
+	
+	uint32_t mapped;	// Length of the OS mapping, or 0 if data came from malloc
+	
+	/* Flags for each page, plus lists of the flagged pages, so that
+	   the written parts can be found without scanning the whole RAM. */
+	uint32_t pageCount;
+	uint8_t *flags;
+	uint32_t *dirtyList;
+	uint32_t dirtyCount;
+	uint32_t *touchedList;
+	uint32_t touchedCount;
+	
+	/* A core view has no storage of its own. It answers reads of
+	   idAddress with coreId, and passes everything else to parent. */
+	struct mips_mem_provider *parent;
+	uint32_t coreId;
+	uint32_t idAddress;
+	
+	/* Devices mapped outside the RAM. They are only looked for once
+	   an address has missed the RAM, so they cost nothing otherwise. */
+	struct mips_mem_device *devices;
+	uint32_t deviceCount;
 };
 
+/* The RAM that actually holds the bytes behind a handle. */
+static mips_mem_h mips_mem_storage(mips_mem_h mem)
+{
+	return (mem && mem->parent) ? mem->parent : mem;
+}
+
+static uint8_t *mips_mem_alloc_data(uint32_t cbMem, uint32_t *mapped)
+{
+	*mapped=0;
+#ifdef __linux__
+	if(cbMem>=RAM_MAP_THRESHOLD){
+		uint32_t length=(cbMem+MIPS_MEM_RAM_PAGE_SIZE-1) & ~(MIPS_MEM_RAM_PAGE_SIZE-1);
+		void *data=mmap(0, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(data!=MAP_FAILED){
+			*mapped=length;
+			return (uint8_t*)data;
+		}
+	}
+#endif
+	// The +1 is so that a zero byte RAM still gets a valid allocation
+	return (uint8_t*)calloc(cbMem+1, 1);
+}
+
+static void mips_mem_free_data(uint8_t *data, uint32_t mapped)
+{
+#ifdef __linux__
+	if(mapped){
+		munmap(data, mapped);
+		return;
+	}
+#endif
+	free(data);
+}
+
 extern "C" mips_mem_h mips_mem_create_ram(
 	uint32_t cbMem	//!< Total number of bytes of ram
 ){
@@ -22,22 +103,94 @@ extern "C" mips_mem_h mips_mem_create_ram(
 		return 0; // No more than 512MB of RAM
 	}
 	
-	uint8_t *data=(uint8_t*)malloc(cbMem);
+	uint32_t mapped;
+	uint8_t *data=mips_mem_alloc_data(cbMem, &mapped);
 	if(data==0)
 		return 0;
 	
+	// The +1 is so that a zero byte RAM still gets valid allocations
+	uint32_t pageCount=(cbMem+MIPS_MEM_RAM_PAGE_SIZE-1)/MIPS_MEM_RAM_PAGE_SIZE;
+	uint8_t *flags=(uint8_t*)calloc(pageCount+1, 1);
+	uint32_t *dirtyList=(uint32_t*)malloc((pageCount+1)*sizeof(uint32_t));
+	uint32_t *touchedList=(uint32_t*)malloc((pageCount+1)*sizeof(uint32_t));
+	
 	struct mips_mem_provider *mem=(struct mips_mem_provider*)malloc(sizeof(struct mips_mem_provider));
-	if(mem==0){
-		free(data);
+	if(mem==0 || flags==0 || dirtyList==0 || touchedList==0){
+		mips_mem_free_data(data, mapped);
+		free(flags);
+		free(dirtyList);
+		free(touchedList);
+		free(mem);
 		return 0;
 	}
 	
 	mem->length=cbMem;
 	mem->data=data;
+	mem->mapped=mapped;
+	mem->pageCount=pageCount;
+	mem->flags=flags;
+	mem->dirtyList=dirtyList;
+	mem->dirtyCount=0;
+	mem->touchedList=touchedList;
+	mem->touchedCount=0;
+	mem->parent=0;
+	mem->coreId=0;
+	mem->idAddress=0;
+	mem->devices=0;
+	mem->deviceCount=0;
 	
 	return mem;
 }
 
+extern "C" mips_mem_h mips_mem_create_core_view(
+	mips_mem_h ram,
+	uint32_t coreId,
+	uint32_t idAddress
+){
+	if(ram==0 || (idAddress%4)!=0){
+		return 0;
+	}
+	
+	struct mips_mem_provider *mem=(struct mips_mem_provider*)calloc(1, sizeof(struct mips_mem_provider));
+	if(mem==0)
+		return 0;
+	
+	mem->parent=mips_mem_storage(ram);
+	mem->coreId=coreId;
+	mem->idAddress=idAddress;
+	return mem;
+}
+
+/* Cores on other threads may be writing to the same page, so the flags
+   are updated with a compare and swap, and whichever thread actually
+   sets a flag is the one that appends the page to the list. */
+static void mips_mem_mark_dirty(mips_mem_h mem, uint32_t page)
+{
+	uint8_t f=__atomic_load_n(&mem->flags[page], __ATOMIC_RELAXED);
+	while(f!=(RAM_DIRTY|RAM_TOUCHED)){
+		if(__atomic_compare_exchange_n(&mem->flags[page], &f, (uint8_t)(RAM_DIRTY|RAM_TOUCHED), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+			if(!(f&RAM_DIRTY)){
+				mem->dirtyList[__atomic_fetch_add(&mem->dirtyCount, 1, __ATOMIC_RELAXED)]=page;
+			}
+			if(!(f&RAM_TOUCHED)){
+				mem->touchedList[__atomic_fetch_add(&mem->touchedCount, 1, __ATOMIC_RELAXED)]=page;
+			}
+			return;
+		}
+	}
+}
+
+static struct mips_mem_device *mips_mem_find_device(mips_mem_h mem, uint32_t address, uint32_t length)
+{
+	for(uint32_t i=0; i<mem->deviceCount; i++){
+		struct mips_mem_device *dev=mem->devices+i;
+		if(address-dev->base < dev->length && length <= dev->length-(address-dev->base)){
+			return dev;
+		}
+	}
+	return 0;
+}
+
 static mips_error mips_mem_read_write(
 	bool write,
     mips_mem_h mem,
@@ -57,17 +210,63 @@ static mips_error mips_mem_read_write(
 	if(0 != (address % length) ){
 		return mips_ExceptionInvalidAlignment;
 	}
+	
+	if(mem->parent){
+		if((address&~3u)==mem->idAddress){
+			if(write){
+				return mips_ExceptionAccessViolation;
+			}
+			uint8_t id[4];
+			id[0]=(uint8_t)(mem->coreId>>24);
+			id[1]=(uint8_t)(mem->coreId>>16);
+			id[2]=(uint8_t)(mem->coreId>>8);
+			id[3]=(uint8_t)(mem->coreId);
+			memcpy(dataOut, id+(address&3), length);
+			return mips_Success;
+		}
+		struct mips_mem_device *dev=mips_mem_find_device(mem, address, length);
+		if(dev){
+			return dev->fn(dev->param, write, address-dev->base, length, dataOut);
+		}
+		mem=mem->parent;
+	}
+	
 	if(((address+length) > mem->length) || (address > (UINT32_MAX - length))){	// A subtle bug here, maybe?
+		struct mips_mem_device *dev=mips_mem_find_device(mem, address, length);
+		if(dev){
+			return dev->fn(dev->param, write, address-dev->base, length, dataOut);
+		}
 		return mips_ExceptionInvalidAddress;
 	}
 	
+	/* Each transaction is a single atomic access, so a core never sees
+	   half of a word written by another core. The bytes are moved as they
+	   are, so this doesn't depend on the byte order of the host. Release
+	   and acquire mean a core that sees a write also sees everything the
+	   writing core did before it, which is free on x86. */
+	uint8_t *data=mem->data+address;
 	if(write){
-		for(unsigned i=0; i<length; i++){
-			mem->data[address+i]=dataOut[i];
+		mips_mem_mark_dirty(mem, address/MIPS_MEM_RAM_PAGE_SIZE);
+		if(length==4){
+			uint32_t v;
+			memcpy(&v, dataOut, 4);
+			__atomic_store_n((uint32_t*)data, v, __ATOMIC_RELEASE);
+		}else if(length==2){
+			uint16_t v;
+			memcpy(&v, dataOut, 2);
+			__atomic_store_n((uint16_t*)data, v, __ATOMIC_RELEASE);
+		}else{
+			__atomic_store_n(data, dataOut[0], __ATOMIC_RELEASE);
 		}
 	}else{
-		for(unsigned i=0; i<length; i++){
-			dataOut[i]=mem->data[address+i];
+		if(length==4){
+			uint32_t v=__atomic_load_n((uint32_t*)data, __ATOMIC_ACQUIRE);
+			memcpy(dataOut, &v, 4);
+		}else if(length==2){
+			uint16_t v=__atomic_load_n((uint16_t*)data, __ATOMIC_ACQUIRE);
+			memcpy(dataOut, &v, 2);
+		}else{
+			dataOut[0]=__atomic_load_n(data, __ATOMIC_ACQUIRE);
 		}
 	}
 	return mips_Success;
@@ -108,8 +307,175 @@ mips_error mips_mem_write(
 void mips_mem_free(mips_mem_h mem)
 {
 	if(mem){
-		free(mem->data);
+		free(mem->devices);
+	}
+	if(mem && mem->parent){
+		free(mem);	// Views don't own the storage
+	}else if(mem){
+		mips_mem_free_data(mem->data, mem->mapped);
 		mem->data=0;
+		free(mem->flags);
+		free(mem->dirtyList);
+		free(mem->touchedList);
 		free(mem);
 	}
 }
+
+mips_error mips_mem_map_device(
+	mips_mem_h mem,
+	uint32_t base,
+	uint32_t length,
+	mips_mem_device_fn fn,
+	void *param
+)
+{
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	if(fn==0 || length==0 || (base%4)!=0 || (length%4)!=0 || base > UINT32_MAX-(length-1)){
+		return mips_ErrorInvalidArgument;
+	}
+	if(base < mips_mem_storage(mem)->length){
+		return mips_ErrorInvalidArgument;	// Would be hidden by the RAM
+	}
+	for(uint32_t i=0; i<mem->deviceCount; i++){
+		const struct mips_mem_device *dev=mem->devices+i;
+		if(base-dev->base < dev->length || dev->base-base < length){
+			return mips_ErrorInvalidArgument;	// Overlaps an existing device
+		}
+	}
+	
+	struct mips_mem_device *devices=(struct mips_mem_device*)realloc(mem->devices, (mem->deviceCount+1)*sizeof(struct mips_mem_device));
+	if(devices==0){
+		return mips_ErrorInvalidArgument;
+	}
+	devices[mem->deviceCount].base=base;
+	devices[mem->deviceCount].length=length;
+	devices[mem->deviceCount].fn=fn;
+	devices[mem->deviceCount].param=param;
+	mem->devices=devices;
+	mem->deviceCount++;
+	return mips_Success;
+}
+
+int mips_mem_has_devices(mips_mem_h mem)
+{
+	if(mem==0){
+		return 0;
+	}
+	return mem->deviceCount>0 || (mem->parent && mem->parent->deviceCount>0);
+}
+
+mips_error mips_mem_ram_get_size(mips_mem_h mem, uint32_t *cbMem)
+{
+	mem=mips_mem_storage(mem);
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	if(cbMem==0){
+		return mips_ErrorInvalidArgument;
+	}
+	*cbMem=mem->length;
+	return mips_Success;
+}
+
+mips_error mips_mem_ram_get_dirty_pages(
+	mips_mem_h mem,
+	uint32_t maxPages,
+	uint32_t *pages,
+	uint32_t *count
+)
+{
+	mem=mips_mem_storage(mem);
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	if(count==0 || (maxPages>0 && pages==0)){
+		return mips_ErrorInvalidArgument;
+	}
+	
+	uint32_t n=mem->dirtyCount < maxPages ? mem->dirtyCount : maxPages;
+	memcpy(pages, mem->dirtyList, n*sizeof(uint32_t));
+	*count=mem->dirtyCount;
+	return mips_Success;
+}
+
+mips_error mips_mem_ram_clear_dirty(mips_mem_h mem)
+{
+	mem=mips_mem_storage(mem);
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	for(uint32_t i=0; i<mem->dirtyCount; i++){
+		mem->flags[mem->dirtyList[i]]&=~RAM_DIRTY;
+	}
+	mem->dirtyCount=0;
+	return mips_Success;
+}
+
+/* Number of bytes actually backed by RAM within the given page. */
+static uint32_t mips_mem_page_length(mips_mem_h mem, uint32_t page)
+{
+	uint32_t begin=page*MIPS_MEM_RAM_PAGE_SIZE;
+	uint32_t left=mem->length-begin;
+	return left < MIPS_MEM_RAM_PAGE_SIZE ? left : MIPS_MEM_RAM_PAGE_SIZE;
+}
+
+mips_error mips_mem_ram_read_page(mips_mem_h mem, uint32_t page, uint8_t *dataOut)
+{
+	mem=mips_mem_storage(mem);
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	if(dataOut==0){
+		return mips_ErrorInvalidArgument;
+	}
+	if(page>=mem->pageCount){
+		return mips_ExceptionInvalidAddress;
+	}
+	memcpy(dataOut, mem->data+page*MIPS_MEM_RAM_PAGE_SIZE, mips_mem_page_length(mem, page));
+	return mips_Success;
+}
+
+mips_error mips_mem_ram_write_page(mips_mem_h mem, uint32_t page, const uint8_t *dataIn)
+{
+	mem=mips_mem_storage(mem);
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	if(dataIn==0){
+		return mips_ErrorInvalidArgument;
+	}
+	if(page>=mem->pageCount){
+		return mips_ExceptionInvalidAddress;
+	}
+	mips_mem_mark_dirty(mem, page);
+	memcpy(mem->data+page*MIPS_MEM_RAM_PAGE_SIZE, dataIn, mips_mem_page_length(mem, page));
+	return mips_Success;
+}
+
+mips_error mips_mem_ram_reset(mips_mem_h mem)
+{
+	mem=mips_mem_storage(mem);
+	if(mem==0){
+		return mips_ErrorInvalidHandle;
+	}
+	
+	bool discarded=false;
+#if defined(__linux__) && defined(MADV_DONTNEED)
+	if(mem->mapped && mem->touchedCount>=RAM_DISCARD_PAGES){
+		// Private anonymous pages read back as zero once discarded
+		discarded = 0==madvise(mem->data, mem->mapped, MADV_DONTNEED);
+	}
+#endif
+	for(uint32_t i=0; i<mem->touchedCount; i++){
+		uint32_t page=mem->touchedList[i];
+		if(!discarded){
+			memset(mem->data+page*MIPS_MEM_RAM_PAGE_SIZE, 0, mips_mem_page_length(mem, page));
+		}
+		mem->flags[page]=0;
+	}
+	mem->touchedCount=0;
+	mem->dirtyCount=0;
+	return mips_Success;
+}
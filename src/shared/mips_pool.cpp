@@ -0,0 +1,121 @@
+/* This file is an implementation of the functions
+   defined in mips_pool.h. It only uses the public
+   CPU API and the RAM reset function, so it can be
+   linked against any CPU implementation.
+*/
+#include "mips_pool.h"
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+struct pool_entry_t
+{
+    mips_cpu_h cpu;
+    mips_mem_h mem;
+    bool acquired;
+};
+
+struct mips_pool_impl
+{
+    uint32_t cbMem;
+
+    std::mutex mutex;
+    std::vector<pool_entry_t> entries;
+    std::vector<unsigned> available;    // Indices of entries that are not acquired
+    std::unordered_map<mips_cpu_h,unsigned> index;  // From CPU back to its entry
+};
+
+/* Creates a new pair and makes it available. Must be called with the mutex held. */
+static bool mips_pool_grow(mips_pool_h pool)
+{
+    mips_mem_h mem=mips_mem_create_ram(pool->cbMem);
+    mips_cpu_h cpu=mem ? mips_cpu_create(mem) : 0;
+    if(cpu==0){
+        mips_mem_free(mem);
+        return false;
+    }
+
+    pool_entry_t entry={cpu, mem, false};
+    pool->index[cpu]=pool->entries.size();
+    pool->available.push_back(pool->entries.size());
+    pool->entries.push_back(entry);
+    return true;
+}
+
+extern "C" mips_pool_h mips_pool_create(uint32_t cbMem, unsigned preallocate)
+{
+    mips_pool_h pool=new mips_pool_impl;
+    pool->cbMem=cbMem;
+    pool->entries.reserve(preallocate);
+    for(unsigned i=0; i<preallocate; i++){
+        if(!mips_pool_grow(pool)){
+            mips_pool_free(pool);
+            return 0;
+        }
+    }
+    return pool;
+}
+
+extern "C" mips_error mips_pool_acquire(mips_pool_h pool, mips_cpu_h *cpu, mips_mem_h *mem)
+{
+    if(pool==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(cpu==0 || mem==0){
+        return mips_ErrorInvalidArgument;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    if(pool->available.empty() && !mips_pool_grow(pool)){
+        return mips_ErrorInvalidHandle;
+    }
+    unsigned i=pool->available.back();
+    pool->available.pop_back();
+
+    pool_entry_t &entry=pool->entries[i];
+    entry.acquired=true;
+    *cpu=entry.cpu;
+    *mem=entry.mem;
+    return mips_Success;
+}
+
+extern "C" mips_error mips_pool_release(mips_pool_h pool, mips_cpu_h cpu)
+{
+    if(pool==0){
+        return mips_ErrorInvalidHandle;
+    }
+
+    unsigned i;
+    mips_mem_h mem;
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        std::unordered_map<mips_cpu_h,unsigned>::const_iterator it=pool->index.find(cpu);
+        if(it==pool->index.end() || !pool->entries[it->second].acquired){
+            return mips_ErrorInvalidArgument;
+        }
+        i=it->second;
+        mem=pool->entries[i].mem;
+    }
+
+    // The pair still belongs to the caller, so it can be reset without the lock
+    mips_mem_ram_reset(mem);
+    mips_cpu_reset(cpu);
+    mips_cpu_set_debug_level(cpu, 0, NULL);
+
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->entries[i].acquired=false;
+    pool->available.push_back(i);
+    return mips_Success;
+}
+
+extern "C" void mips_pool_free(mips_pool_h pool)
+{
+    if(pool){
+        for(unsigned i=0; i<pool->entries.size(); i++){
+            mips_cpu_free(pool->entries[i].cpu);
+            mips_mem_free(pool->entries[i].mem);
+        }
+        delete pool;
+    }
+}
@@ -0,0 +1,540 @@
+/* This file is an implementation of the functions
+   defined in mips_replay.h. It only uses the public
+   CPU API, plus the page functions of the RAM, so it
+   can be linked against any CPU implementation.
+*/
+#include "mips_replay.h"
+#include "mips_isa.h"
+
+#include <vector>
+#include <algorithm>
+
+enum replay_event_kind_t
+{
+    replay_SetRegister,
+    replay_SetPc,
+    replay_Write
+};
+
+/* Something done to the CPU or memory from outside, which
+   needs to be done again at the same point during replay. */
+struct replay_event_t
+{
+    uint64_t position;
+    replay_event_kind_t kind;
+    uint32_t index;     // register index, or byte address
+    uint32_t value;     // register value, or pc
+    uint32_t length;
+    uint8_t data[4];
+};
+
+struct replay_checkpoint_t
+{
+    uint64_t position;
+    uint32_t pc;
+    uint32_t regs[32];
+    size_t firstEvent;  // First event logged at or after this position
+    size_t storeBegin;  // Where the pages of this checkpoint start in the store
+
+    /* Restoring resets HI and LO to zero, which is only right if they
+       hadn't been written since they were last zero. Otherwise the
+       checkpoint can still be used to reach positions after the next
+       write to them, as long as nothing reads them first. These are the
+       first positions the checkpoint gives the right HI and LO for, or
+       REPLAY_NEVER while that isn't known. */
+    uint64_t hiFrom, loFrom;
+    uint64_t readAt;    // Where one was read while still unknown, making the checkpoint useless
+};
+
+#define REPLAY_NEVER (~(uint64_t)0)
+
+// Which of HI and LO an instruction touches
+#define REPLAY_HI 1u
+#define REPLAY_LO 2u
+
+/* One saved copy of a page, belonging to a particular checkpoint. */
+struct page_version_t
+{
+    uint32_t checkpoint;
+    size_t offset;
+};
+
+struct mips_replay_impl
+{
+    mips_cpu_h cpu;
+    mips_mem_h mem;
+    uint32_t interval;
+
+    uint64_t position;  // Instructions executed to reach the current state
+    uint64_t end;       // Furthest position that has been recorded
+
+    size_t nextEvent;       // Next event to apply when replaying
+    size_t nextCheckpoint;  // First checkpoint after the current position
+    unsigned hiloWritten;   // REPLAY_HI/LO if it may have been written since it was zero
+
+    std::vector<replay_event_t> events;
+    std::vector<replay_checkpoint_t> checkpoints;
+    std::vector<uint32_t> undecided;    // Checkpoints waiting for a write to HI or LO
+
+    // For each page, every version saved by a checkpoint, in checkpoint order.
+    std::vector<std::vector<page_version_t> > pages;
+    std::vector<uint8_t> store;
+};
+
+/* Updates what we know about HI and LO after the instruction which
+   took the CPU to the current position, and says whether it is safe
+   to take a checkpoint straight after it. */
+static bool replay_track_instruction(mips_replay_h h, uint32_t instr)
+{
+    int index=mips_isa_decode(instr);
+    if(index<0){
+        return true;
+    }
+    unsigned flags=mips_isa_get(index)->flags;
+    unsigned funct=instr&0x3F;
+    unsigned reads=0, writes=0;
+    if(flags & mips_isa_ReadsHiLo){
+        reads = funct==0x10 ? REPLAY_HI : REPLAY_LO;    // MFHI or MFLO
+    }
+    if(flags & mips_isa_WritesHiLo){
+        writes = funct==0x11 ? REPLAY_HI : funct==0x13 ? REPLAY_LO : REPLAY_HI|REPLAY_LO;
+    }
+
+    if(reads|writes){
+        /* Settle the checkpoints this instruction comes after. When replaying,
+           ones after the current position were decided by the same
+           instructions while recording. */
+        size_t kept=0;
+        for(size_t i=0; i<h->undecided.size(); i++){
+            replay_checkpoint_t &cp=h->checkpoints[h->undecided[i]];
+            bool decided=false;
+            if(cp.position < h->position){
+                if((reads&REPLAY_HI && cp.hiFrom==REPLAY_NEVER) || (reads&REPLAY_LO && cp.loFrom==REPLAY_NEVER)){
+                    cp.readAt=h->position;
+                    decided=true;
+                }else{
+                    if(writes&REPLAY_HI && cp.hiFrom==REPLAY_NEVER){
+                        cp.hiFrom=h->position;
+                    }
+                    if(writes&REPLAY_LO && cp.loFrom==REPLAY_NEVER){
+                        cp.loFrom=h->position;
+                    }
+                    decided = cp.hiFrom!=REPLAY_NEVER && cp.loFrom!=REPLAY_NEVER;
+                }
+            }
+            if(!decided){
+                h->undecided[kept++]=h->undecided[i];
+            }
+        }
+        h->undecided.resize(kept);
+        h->hiloWritten|=writes;
+    }
+
+    // A branch or jump leaves the CPU waiting to execute its delay slot
+    return !(flags & (mips_isa_Branch | mips_isa_Jump));
+}
+
+/* Whether restoring a checkpoint and stepping on gives the right state at position. */
+static bool replay_usable(const replay_checkpoint_t &cp, uint64_t position)
+{
+    return cp.position<=position && cp.readAt==REPLAY_NEVER && cp.hiFrom<=position && cp.loFrom<=position;
+}
+
+static mips_error replay_save_page(mips_replay_h h, uint32_t page)
+{
+    size_t offset=h->store.size();
+    h->store.resize(offset+MIPS_MEM_RAM_PAGE_SIZE);
+    mips_error err=mips_mem_ram_read_page(h->mem, page, &h->store[offset]);
+    if(err){
+        return err;
+    }
+    page_version_t version;
+    version.checkpoint=h->checkpoints.size();
+    version.offset=offset;
+    h->pages[page].push_back(version);
+    return mips_Success;
+}
+
+static mips_error replay_take_checkpoint(mips_replay_h h)
+{
+    replay_checkpoint_t cp;
+    cp.position=h->position;
+    cp.firstEvent=h->events.size();
+    cp.storeBegin=h->store.size();
+    cp.hiFrom = (h->hiloWritten & REPLAY_HI) ? REPLAY_NEVER : h->position;
+    cp.loFrom = (h->hiloWritten & REPLAY_LO) ? REPLAY_NEVER : h->position;
+    cp.readAt=REPLAY_NEVER;
+
+    mips_error err=mips_cpu_get_pc(h->cpu, &cp.pc);
+    for(unsigned i=0; i<32 && !err; i++){
+        err=mips_cpu_get_register(h->cpu, i, &cp.regs[i]);
+    }
+
+    uint32_t count=0;
+    if(!err){
+        err=mips_mem_ram_get_dirty_pages(h->mem, 0, 0, &count);
+    }
+    std::vector<uint32_t> dirty(count);
+    if(!err && count>0){
+        err=mips_mem_ram_get_dirty_pages(h->mem, count, &dirty[0], &count);
+    }
+    for(unsigned i=0; i<count && !err; i++){
+        err=replay_save_page(h, dirty[i]);
+    }
+    if(err){
+        return err;
+    }
+
+    mips_mem_ram_clear_dirty(h->mem);
+    if(h->hiloWritten){
+        h->undecided.push_back(h->checkpoints.size());
+    }
+    h->checkpoints.push_back(cp);
+    h->nextCheckpoint=h->checkpoints.size();
+    return mips_Success;
+}
+
+static mips_error replay_apply_events(mips_replay_h h)
+{
+    while(h->nextEvent < h->events.size() && h->events[h->nextEvent].position==h->position){
+        const replay_event_t &ev=h->events[h->nextEvent];
+        mips_error err=mips_Success;
+        switch(ev.kind){
+        case replay_SetRegister:
+            err=mips_cpu_set_register(h->cpu, ev.index, ev.value);
+            break;
+        case replay_SetPc:
+            err=mips_cpu_set_pc(h->cpu, ev.value);
+            break;
+        case replay_Write:
+            err=mips_mem_write(h->mem, ev.index, ev.length, ev.data);
+            break;
+        }
+        if(err){
+            return err;
+        }
+        h->nextEvent++;
+    }
+    return mips_Success;
+}
+
+/* Puts the CPU and RAM back into the state of checkpoint k. The pages
+   that can differ are the ones written since the last checkpoint we
+   passed, and the ones with a version saved after either that
+   checkpoint or checkpoint k. */
+static mips_error replay_restore(mips_replay_h h, uint32_t k)
+{
+    const replay_checkpoint_t &cp=h->checkpoints[k];
+    uint32_t base=std::min<uint32_t>(k, h->nextCheckpoint-1);
+
+    std::vector<uint8_t> revert(h->pages.size(), 0);
+    uint32_t count=0;
+    mips_error err=mips_mem_ram_get_dirty_pages(h->mem, 0, 0, &count);
+    std::vector<uint32_t> dirty(count);
+    if(!err && count>0){
+        err=mips_mem_ram_get_dirty_pages(h->mem, count, &dirty[0], &count);
+    }
+    if(err){
+        return err;
+    }
+    for(unsigned i=0; i<count; i++){
+        revert[dirty[i]]=1;
+    }
+
+    for(uint32_t page=0; page<h->pages.size(); page++){
+        const std::vector<page_version_t> &versions=h->pages[page];
+        if(!revert[page] && versions.back().checkpoint<=base){
+            continue;
+        }
+        // Latest version saved at or before checkpoint k. Checkpoint 0 saved every page.
+        size_t i=versions.size()-1;
+        while(versions[i].checkpoint>k){
+            --i;
+        }
+        err=mips_mem_ram_write_page(h->mem, page, &h->store[versions[i].offset]);
+        if(err){
+            return err;
+        }
+    }
+    mips_mem_ram_clear_dirty(h->mem);
+
+    err=mips_cpu_reset(h->cpu);
+    for(unsigned i=1; i<32 && !err; i++){
+        err=mips_cpu_set_register(h->cpu, i, cp.regs[i]);
+    }
+    if(!err){
+        err=mips_cpu_set_pc(h->cpu, cp.pc);
+    }
+    if(err){
+        return err;
+    }
+
+    h->position=cp.position;
+    h->nextEvent=cp.firstEvent;
+    h->nextCheckpoint=k+1;
+    /* HI and LO are zero now. Any that weren't here are written again
+       before the position being restored for, which sets them again. */
+    h->hiloWritten=0;
+    return replay_apply_events(h);
+}
+
+/* Called before the host changes anything. If we are behind the end
+   of the recording then the future we recorded can no longer happen. */
+static void replay_truncate(mips_replay_h h)
+{
+    if(h->position>=h->end){
+        return;
+    }
+
+    h->events.resize(h->nextEvent);
+
+    if(h->nextCheckpoint < h->checkpoints.size()){
+        uint32_t first=h->nextCheckpoint;
+        for(unsigned i=0; i<h->pages.size(); i++){
+            std::vector<page_version_t> &versions=h->pages[i];
+            while(versions.back().checkpoint>=first){
+                versions.pop_back();
+            }
+        }
+        h->store.resize(h->checkpoints[first].storeBegin);
+        h->checkpoints.resize(first);
+    }
+
+    // Forget what the discarded instructions told us about HI and LO
+    h->undecided.clear();
+    for(uint32_t i=0; i<h->checkpoints.size(); i++){
+        replay_checkpoint_t &cp=h->checkpoints[i];
+        if(cp.readAt > h->position){
+            cp.readAt=REPLAY_NEVER;
+        }
+        if(cp.hiFrom > h->position){
+            cp.hiFrom=REPLAY_NEVER;
+        }
+        if(cp.loFrom > h->position){
+            cp.loFrom=REPLAY_NEVER;
+        }
+        if(cp.readAt==REPLAY_NEVER && (cp.hiFrom==REPLAY_NEVER || cp.loFrom==REPLAY_NEVER)){
+            h->undecided.push_back(i);
+        }
+    }
+
+    h->end=h->position;
+}
+
+extern "C" mips_replay_h mips_replay_create(
+    mips_cpu_h cpu,
+    mips_mem_h mem,
+    uint32_t checkpointInterval
+)
+{
+    if(cpu==0 || mem==0 || checkpointInterval==0){
+        return 0;
+    }
+
+    uint32_t cbMem;
+    if(mips_mem_ram_get_size(mem, &cbMem)){
+        return 0;
+    }
+    if(mips_mem_has_devices(mem)){
+        return 0;   // Their reads and writes can't be replayed
+    }
+
+    mips_replay_h h=new mips_replay_impl;
+    h->cpu=cpu;
+    h->mem=mem;
+    h->interval=checkpointInterval;
+    h->position=0;
+    h->end=0;
+    h->nextEvent=0;
+    h->nextCheckpoint=0;
+    h->hiloWritten=0;
+
+    uint32_t pageCount=(cbMem+MIPS_MEM_RAM_PAGE_SIZE-1)/MIPS_MEM_RAM_PAGE_SIZE;
+    h->pages.resize(pageCount);
+    h->store.reserve(pageCount*(size_t)MIPS_MEM_RAM_PAGE_SIZE);
+
+    // The first checkpoint holds the whole of RAM, so every page always has a version to go back to
+    mips_error err=mips_Success;
+    for(uint32_t page=0; page<pageCount && !err; page++){
+        err=replay_save_page(h, page);
+    }
+    if(!err){
+        mips_mem_ram_clear_dirty(mem);
+        err=replay_take_checkpoint(h);
+        h->checkpoints[0].storeBegin=0;
+    }
+    if(err){
+        delete h;
+        return 0;
+    }
+    return h;
+}
+
+extern "C" mips_error mips_replay_step(mips_replay_h h)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+
+    // Look at what is about to execute, to know whether it is safe to checkpoint afterwards
+    uint32_t pc, instr=0;
+    uint8_t bytes[4];
+    mips_error err=mips_cpu_get_pc(h->cpu, &pc);
+    if(!err && !mips_mem_read(h->mem, pc, 4, bytes)){
+        instr=(bytes[0]<<24) | (bytes[1]<<16) | (bytes[2]<<8) | bytes[3];
+    }
+    if(!err){
+        err=mips_cpu_step(h->cpu);
+    }
+    if(err){
+        return err;
+    }
+
+    h->position++;
+    bool safe=replay_track_instruction(h, instr);
+
+    if(h->position > h->end){
+        h->end=h->position;
+
+        // A checkpoint that turned out to be useless doesn't count towards the interval
+        size_t last=h->checkpoints.size()-1;
+        while(h->checkpoints[last].readAt!=REPLAY_NEVER){
+            --last;
+        }
+        if(h->position-h->checkpoints[last].position >= h->interval && safe){
+            err=replay_take_checkpoint(h);
+        }
+        return err;
+    }
+
+    // Replaying: passing a recorded checkpoint means memory matches it again
+    if(h->nextCheckpoint < h->checkpoints.size() && h->checkpoints[h->nextCheckpoint].position==h->position){
+        mips_mem_ram_clear_dirty(h->mem);
+        h->nextCheckpoint++;
+    }
+    return replay_apply_events(h);
+}
+
+extern "C" mips_error mips_replay_seek(mips_replay_h h, uint64_t position)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+
+    // Find the last checkpoint that can be used to reach the target. Checkpoint 0 always can.
+    uint32_t k=h->checkpoints.size()-1;
+    while(!replay_usable(h->checkpoints[k], position)){
+        --k;
+    }
+
+    // Restoring is also worth doing to jump forwards over recorded history
+    if(position < h->position || h->checkpoints[k].position > h->position){
+        mips_error err=replay_restore(h, k);
+        if(err){
+            return err;
+        }
+    }
+
+    while(h->position < position){
+        mips_error err=mips_replay_step(h);
+        if(err){
+            return err;
+        }
+    }
+    return mips_Success;
+}
+
+extern "C" mips_error mips_replay_step_back(mips_replay_h h)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(h->position==0){
+        return mips_ErrorInvalidArgument;
+    }
+    return mips_replay_seek(h, h->position-1);
+}
+
+extern "C" mips_error mips_replay_get_position(mips_replay_h h, uint64_t *position)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(position==0){
+        return mips_ErrorInvalidArgument;
+    }
+    *position=h->position;
+    return mips_Success;
+}
+
+static mips_error replay_log(mips_replay_h h, const replay_event_t &ev)
+{
+    h->events.push_back(ev);
+    h->nextEvent=h->events.size();
+    return mips_Success;
+}
+
+extern "C" mips_error mips_replay_set_register(mips_replay_h h, unsigned index, uint32_t value)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+    replay_truncate(h);
+    mips_error err=mips_cpu_set_register(h->cpu, index, value);
+    if(err){
+        return err;
+    }
+
+    replay_event_t ev=replay_event_t();
+    ev.position=h->position;
+    ev.kind=replay_SetRegister;
+    ev.index=index;
+    ev.value=value;
+    return replay_log(h, ev);
+}
+
+extern "C" mips_error mips_replay_set_pc(mips_replay_h h, uint32_t pc)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+    replay_truncate(h);
+    mips_error err=mips_cpu_set_pc(h->cpu, pc);
+    if(err){
+        return err;
+    }
+
+    replay_event_t ev=replay_event_t();
+    ev.position=h->position;
+    ev.kind=replay_SetPc;
+    ev.value=pc;
+    return replay_log(h, ev);
+}
+
+extern "C" mips_error mips_replay_write(mips_replay_h h, uint32_t address, uint32_t length, const uint8_t *dataIn)
+{
+    if(h==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(dataIn==0 || length>4){
+        return mips_ErrorInvalidArgument;
+    }
+    replay_truncate(h);
+    mips_error err=mips_mem_write(h->mem, address, length, dataIn);
+    if(err){
+        return err;
+    }
+
+    replay_event_t ev=replay_event_t();
+    ev.position=h->position;
+    ev.kind=replay_Write;
+    ev.index=address;
+    ev.length=length;
+    std::copy(dataIn, dataIn+length, ev.data);
+    return replay_log(h, ev);
+}
+
+extern "C" void mips_replay_free(mips_replay_h h)
+{
+    delete h;
+}
@@ -0,0 +1,311 @@
+/* This file is an implementation of the functions
+   defined in mips_sched.h. It only uses the public
+   CPU API, so it can be linked against any CPU
+   implementation.
+*/
+#include "mips_sched.h"
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+struct sched_context_t
+{
+    mips_cpu_h cpu;
+    uint64_t maxSteps;
+    uint64_t steps;
+    uint32_t haltPc;
+    mips_error err;
+    uint8_t state;      // A mips_sched_state, only changed atomically
+    uint8_t skip;       // Don't check for a breakpoint before the next step
+    uint16_t thread;    // Worker that owns the context
+};
+
+/* Contexts that are ready at the start of a run or have been woken,
+   waiting to be picked up by the thread that owns them. */
+struct sched_inbox_t
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<unsigned> woken;
+};
+
+struct mips_sched_impl
+{
+    unsigned threads;
+    uint32_t slice;
+
+    std::vector<sched_context_t> contexts;
+    std::vector<uint32_t> breakpoints;  // Sorted
+    mips_sched_break_fn handler;
+    void *param;
+
+    std::vector<sched_inbox_t> inboxes;
+    std::atomic<unsigned> runnable;     // Contexts which are ready, on any thread
+    bool running;
+};
+
+static uint8_t sched_get_state(const sched_context_t &c)
+{
+    return __atomic_load_n(&c.state, __ATOMIC_ACQUIRE);
+}
+
+/* Called by the owning thread when a ready context stops being ready. */
+static void sched_retire(mips_sched_h sched, sched_context_t &c, mips_sched_state state)
+{
+    __atomic_store_n(&c.state, (uint8_t)state, __ATOMIC_RELEASE);
+    if(--sched->runnable==0){
+        // Let any idle threads see that there is nothing left to do
+        for(unsigned i=0; i<sched->threads; i++){
+            std::lock_guard<std::mutex> lock(sched->inboxes[i].mutex);
+            sched->inboxes[i].cv.notify_all();
+        }
+    }
+}
+
+/* Retires a context because reading or stepping its CPU failed. */
+static bool sched_fail(mips_sched_h sched, sched_context_t &c, mips_error err)
+{
+    c.err=err;
+    sched_retire(sched, c, mips_sched_Failed);
+    return false;
+}
+
+/* Runs one slice of a context. Returns true if it is still ready, and
+   should go round again. Once a context has been retired it might be
+   woken straight away by another thread, so its state can't be used
+   to decide this. */
+static bool sched_slice(mips_sched_h sched, unsigned id)
+{
+    sched_context_t &c=sched->contexts[id];
+    for(uint32_t n=0; n<sched->slice; n++){
+        uint32_t pc;
+        mips_error err=mips_cpu_get_pc(c.cpu, &pc);
+        if(err){
+            return sched_fail(sched, c, err);
+        }
+        if(pc==c.haltPc){
+            sched_retire(sched, c, mips_sched_Halted);
+            return false;
+        }
+
+        if(!c.skip && !sched->breakpoints.empty()
+            && std::binary_search(sched->breakpoints.begin(), sched->breakpoints.end(), pc)
+        ){
+            mips_sched_state next = sched->handler ? sched->handler(sched->param, sched, id, c.cpu) : mips_sched_Halted;
+            if(next==mips_sched_Halted){
+                sched_retire(sched, c, mips_sched_Halted);
+                return false;
+            }
+            // The callback may have moved the pc on, in which case the new pc gets checked
+            uint32_t after;
+            err=mips_cpu_get_pc(c.cpu, &after);
+            if(err){
+                return sched_fail(sched, c, err);
+            }
+            c.skip = (after==pc);
+            if(next==mips_sched_Blocked){
+                sched_retire(sched, c, mips_sched_Blocked);
+                return false;
+            }
+            continue;
+        }
+        c.skip=0;
+
+        if(c.maxSteps && c.steps==c.maxSteps){
+            sched_retire(sched, c, mips_sched_Limited);
+            return false;
+        }
+        err=mips_cpu_step(c.cpu);
+        if(err){
+            return sched_fail(sched, c, err);
+        }
+        c.steps++;
+    }
+    return true;
+}
+
+static void sched_worker(mips_sched_h sched, unsigned thread)
+{
+    std::deque<unsigned> queue;
+    sched_inbox_t &inbox=sched->inboxes[thread];
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(inbox.mutex);
+            if(queue.empty()){
+                // Another thread might still wake one of ours
+                inbox.cv.wait(lock, [&]{ return !inbox.woken.empty() || sched->runnable==0; });
+                if(inbox.woken.empty()){
+                    return;
+                }
+            }
+            queue.insert(queue.end(), inbox.woken.begin(), inbox.woken.end());
+            inbox.woken.clear();
+        }
+
+        // Run each queued context for a slice before looking at the inbox again
+        for(size_t i=queue.size(); i>0; i--){
+            unsigned id=queue.front();
+            queue.pop_front();
+            if(sched_slice(sched, id)){
+                queue.push_back(id);
+            }
+        }
+    }
+}
+
+extern "C" mips_sched_h mips_sched_create(unsigned threads, uint32_t slice)
+{
+    if(slice==0){
+        return 0;
+    }
+    if(threads==0){
+        threads=std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    mips_sched_h sched=new mips_sched_impl;
+    sched->threads=threads;
+    sched->slice=slice;
+    sched->handler=0;
+    sched->param=0;
+    sched->inboxes=std::vector<sched_inbox_t>(threads);
+    sched->runnable=0;
+    sched->running=false;
+    return sched;
+}
+
+extern "C" mips_error mips_sched_add(
+    mips_sched_h sched,
+    mips_cpu_h cpu,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    unsigned *id
+){
+    if(sched==0 || cpu==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(id==0 || sched->running){
+        return mips_ErrorInvalidArgument;
+    }
+
+    sched_context_t c;
+    c.cpu=cpu;
+    c.maxSteps=maxSteps;
+    c.steps=0;
+    c.haltPc=haltPc;
+    c.err=mips_Success;
+    c.state=mips_sched_Ready;
+    c.skip=0;
+    c.thread=sched->contexts.size() % sched->threads;
+    *id=sched->contexts.size();
+    sched->contexts.push_back(c);
+    sched->runnable++;
+    return mips_Success;
+}
+
+extern "C" mips_error mips_sched_set_break_handler(mips_sched_h sched, mips_sched_break_fn handler, void *param)
+{
+    if(sched==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(sched->running){
+        return mips_ErrorInvalidArgument;
+    }
+    sched->handler=handler;
+    sched->param=param;
+    return mips_Success;
+}
+
+extern "C" mips_error mips_sched_add_breakpoint(mips_sched_h sched, uint32_t pc)
+{
+    if(sched==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(sched->running){
+        return mips_ErrorInvalidArgument;
+    }
+    std::vector<uint32_t>::iterator it=std::lower_bound(sched->breakpoints.begin(), sched->breakpoints.end(), pc);
+    if(it==sched->breakpoints.end() || *it!=pc){
+        sched->breakpoints.insert(it, pc);
+    }
+    return mips_Success;
+}
+
+extern "C" mips_error mips_sched_run(mips_sched_h sched)
+{
+    if(sched==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(sched->running){
+        return mips_ErrorInvalidArgument;
+    }
+
+    // The ready contexts are handed out before any thread starts, as
+    // once one does it can wake others, which then get queued again
+    for(unsigned id=0; id<sched->contexts.size(); id++){
+        const sched_context_t &c=sched->contexts[id];
+        if(sched_get_state(c)==mips_sched_Ready){
+            sched->inboxes[c.thread].woken.push_back(id);
+        }
+    }
+
+    sched->running=true;
+    std::vector<std::thread> workers;
+    for(unsigned i=1; i<sched->threads; i++){
+        workers.push_back(std::thread(sched_worker, sched, i));
+    }
+    sched_worker(sched, 0);
+    for(unsigned i=0; i<workers.size(); i++){
+        workers[i].join();
+    }
+    sched->running=false;
+    return mips_Success;
+}
+
+extern "C" mips_error mips_sched_wake(mips_sched_h sched, unsigned id)
+{
+    if(sched==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(id>=sched->contexts.size()){
+        return mips_ErrorInvalidArgument;
+    }
+
+    sched_context_t &c=sched->contexts[id];
+    uint8_t expected=mips_sched_Blocked;
+    if(!__atomic_compare_exchange_n(&c.state, &expected, (uint8_t)mips_sched_Ready, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        return mips_Success;    // Wasn't blocked
+    }
+    sched->runnable++;
+    if(sched->running){
+        sched_inbox_t &inbox=sched->inboxes[c.thread];
+        std::lock_guard<std::mutex> lock(inbox.mutex);
+        inbox.woken.push_back(id);
+        inbox.cv.notify_all();
+    }
+    return mips_Success;
+}
+
+extern "C" mips_error mips_sched_get_status(mips_sched_h sched, unsigned id, mips_sched_status *status)
+{
+    if(sched==0){
+        return mips_ErrorInvalidHandle;
+    }
+    if(id>=sched->contexts.size() || status==0){
+        return mips_ErrorInvalidArgument;
+    }
+    const sched_context_t &c=sched->contexts[id];
+    status->state=(mips_sched_state)sched_get_state(c);
+    status->err=c.err;
+    status->steps=c.steps;
+    return mips_Success;
+}
+
+extern "C" void mips_sched_free(mips_sched_h sched)
+{
+    delete sched;
+}
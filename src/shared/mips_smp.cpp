@@ -0,0 +1,155 @@
+/* This file is an implementation of the functions
+   defined in mips_smp.h. It only uses the public
+   CPU API, so it can be linked against any CPU
+   implementation.
+*/
+#include "mips_smp.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/* Number of steps a free-running core makes between checks of
+   whether another core has failed. */
+#define SMP_CHECK_STEPS 1024
+
+/* A barrier that cores can leave once they have stopped, so that the
+   remaining cores don't wait for them. */
+struct smp_barrier_t
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned active;
+    unsigned waiting;
+    uint64_t generation;
+
+    void release()
+    {
+        waiting=0;
+        generation++;
+        cv.notify_all();
+    }
+
+    void arrive()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(++waiting==active){
+            release();
+        }else{
+            uint64_t g=generation;
+            cv.wait(lock, [&]{ return generation!=g; });
+        }
+    }
+
+    void leave()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active--;
+        if(waiting>0 && waiting==active){
+            release();
+        }
+    }
+};
+
+struct smp_shared_t
+{
+    uint32_t haltPc;
+    uint64_t maxSteps;
+    uint32_t quantum;
+    smp_barrier_t barrier;
+    std::atomic<bool> failed;
+};
+
+static void smp_core(smp_shared_t *shared, mips_cpu_h cpu, mips_smp_result *res)
+{
+    res->err=mips_Success;
+    res->halted=0;
+    res->steps=0;
+
+    uint32_t budget = shared->quantum ? shared->quantum : SMP_CHECK_STEPS;
+    bool stopped=false;
+    while(!stopped){
+        for(uint32_t i=0; i<budget; i++){
+            uint32_t pc;
+            res->err=mips_cpu_get_pc(cpu, &pc);
+            if(res->err){
+                shared->failed=true;
+                stopped=true;
+                break;
+            }
+            if(pc==shared->haltPc){
+                res->halted=1;
+                stopped=true;
+                break;
+            }
+            if(shared->maxSteps && res->steps==shared->maxSteps){
+                stopped=true;
+                break;
+            }
+            res->err=mips_cpu_step(cpu);
+            if(res->err){
+                shared->failed=true;
+                stopped=true;
+                break;
+            }
+            res->steps++;
+        }
+        if(!stopped && shared->quantum){
+            shared->barrier.arrive();
+        }
+        stopped = stopped || shared->failed;
+    }
+    // Setting failed happens before leaving, so the others see it when they wake up
+    shared->barrier.leave();
+}
+
+extern "C" mips_error mips_smp_run(
+    unsigned count,
+    const mips_cpu_h *cpus,
+    uint32_t haltPc,
+    uint64_t maxSteps,
+    uint32_t quantum,
+    mips_smp_result *results
+){
+    if(count==0 || cpus==0){
+        return mips_ErrorInvalidArgument;
+    }
+    for(unsigned i=0; i<count; i++){
+        if(cpus[i]==0){
+            return mips_ErrorInvalidHandle;
+        }
+    }
+
+    smp_shared_t shared;
+    shared.haltPc=haltPc;
+    shared.maxSteps=maxSteps;
+    shared.quantum=quantum;
+    shared.barrier.active=count;
+    shared.barrier.waiting=0;
+    shared.barrier.generation=0;
+    shared.failed=false;
+
+    std::vector<mips_smp_result> local(count);
+    std::vector<std::thread> threads;
+    threads.reserve(count-1);
+    for(unsigned i=1; i<count; i++){
+        threads.push_back(std::thread(smp_core, &shared, cpus[i], &local[i]));
+    }
+    smp_core(&shared, cpus[0], &local[0]);  // The calling thread is core 0
+    for(unsigned i=0; i<threads.size(); i++){
+        threads[i].join();
+    }
+
+    mips_error err=mips_Success;
+    for(unsigned i=0; i<count; i++){
+        if(results){
+            results[i]=local[i];
+        }
+        if(!err && local[i].err){
+            err=local[i].err;
+        }
+    }
+    return err;
+}
@@ -5,25 +5,19 @@
    some sort of main program to run the tests.
 */
 #include "mips_test.h"
+#include "mips_pool.h"
 
 #include <map>
 #include <string>
 #include <vector>
-#include <set>
+#include <deque>
 #include <algorithm>
 #include <string> 
-
-static bool sg_started=false;
-
-struct test_info_t
-{
-    int testId;
-    std::string instruction;
-    int status;
-    std::string message;
-};
-
-static std::vector<test_info_t> sg_tests;
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 
 struct instr_info_t
 {
@@ -31,6 +25,7 @@ struct instr_info_t
     const char *description;
 };
 
+// This is kept in sorted order, so that names can be found with a binary search
 static const instr_info_t sg_instructionsArray[]=
 {
     {"<INTERNAL>", "Tests of things other than intructions."},
@@ -90,110 +85,545 @@ static const instr_info_t sg_instructionsArray[]=
 };
 static const unsigned sg_instructionsCount = sizeof(sg_instructionsArray)/sizeof(sg_instructionsArray[0]);
 
-static std::set<std::string> sg_knownInstructions;
+
+/* Instruction names are interned, so each test only needs to
+   carry an index. The known instructions are indices 0 to
+   sg_instructionsCount-1, and any other names given to
+   mips_test_begin_test are numbered after them. */
+static std::deque<std::string> sg_unknownNames;
+static std::map<std::string,unsigned> sg_unknownIndices;
+static std::mutex sg_unknownMutex;
+
+typedef std::chrono::steady_clock test_clock_t;
+
+struct test_info_t
+{
+    int testId;
+    unsigned instruction;
+    int status;
+    std::string message;
+    double seconds;         // Time from begin to end of the test
+    int64_t retired;        // Instructions executed, or -1 if not reported
+};
+
+struct instr_stats_t
+{
+    int tests;
+    int passed;
+    double seconds;
+    double maxSeconds;
+    int64_t retired;
+};
+
+struct test_job_t
+{
+    mips_test_fn fn;
+    void *arg;
+    uint32_t cbMem;
+};
+
+struct mips_test_suite_impl
+{
+    bool started;
+    int testCount;              // Number of tests started so far
+    test_info_t current;        // The most recently started test
+    test_clock_t::time_point currentStart;
+    
+    std::vector<instr_stats_t> statistics;  // Indexed by interned instruction
+    
+    /* Completed tests. When streaming, passed tests are only counted,
+       and failed tests are kept here only if there is no file to write
+       them to. */
+    std::vector<test_info_t> tests;
+    bool streaming;
+    FILE *failures;
+    
+    // Machine readable reports to write at the end of the suite, if any
+    test_clock_t::time_point startTime;
+    std::string jsonPath;
+    std::string junitPath;
+    
+    std::vector<test_job_t> jobs;
+};
+
+// The suite used by mips_test_begin_suite and friends
+static mips_test_suite_impl sg_suite;
+
+// Suite of the registered function running on this thread, if any
+static thread_local mips_test_suite_h sg_current=0;
+
+static const char *mips_test_name(unsigned instruction)
+{
+    if(instruction<sg_instructionsCount){
+        return sg_instructionsArray[instruction].instruction;
+    }
+    std::lock_guard<std::mutex> lock(sg_unknownMutex);
+    return sg_unknownNames[instruction-sg_instructionsCount].c_str();
+}
+
+static bool mips_test_name_less(const instr_info_t &info, const char *name)
+{
+    return strcmp(info.instruction, name) < 0;
+}
+
+/* Returns the index of an (upper case) name, and sets isNew if this
+   is the first time an unknown name has been seen. */
+static unsigned mips_test_intern(const std::string &name, bool *isNew)
+{
+    *isNew=false;
+    
+    const instr_info_t *end=sg_instructionsArray+sg_instructionsCount;
+    const instr_info_t *it=std::lower_bound(sg_instructionsArray, end, name.c_str(), mips_test_name_less);
+    if(it!=end && name==it->instruction){
+        return it-sg_instructionsArray;
+    }
+    
+    std::lock_guard<std::mutex> lock(sg_unknownMutex);
+    std::map<std::string,unsigned>::const_iterator found=sg_unknownIndices.find(name);
+    if(found!=sg_unknownIndices.end()){
+        return found->second;
+    }
+    unsigned index=sg_instructionsCount+sg_unknownNames.size();
+    sg_unknownNames.push_back(name);
+    sg_unknownIndices[name]=index;
+    *isNew=true;
+    return index;
+}
+
+static void mips_test_add_statistics(mips_test_suite_h suite, unsigned instruction, const instr_stats_t &delta)
+{
+    if(suite->statistics.size()<=instruction){
+        instr_stats_t zero={0,0,0.0,0.0,0};
+        suite->statistics.resize(instruction+1, zero);
+    }
+    instr_stats_t &stats=suite->statistics[instruction];
+    stats.tests+=delta.tests;
+    stats.passed+=delta.passed;
+    stats.seconds+=delta.seconds;
+    stats.maxSeconds=std::max(stats.maxSeconds, delta.maxSeconds);
+    stats.retired+=delta.retired;
+}
+
+/* Holds on to a completed test, or writes it out if streaming. */
+static void mips_test_keep(mips_test_suite_h suite, const test_info_t &info)
+{
+    if(!suite->streaming){
+        suite->tests.push_back(info);
+    }else if(info.status!=1){
+        if(suite->failures){
+            fprintf(suite->failures, "%d\t%s\t%s\n", info.testId, mips_test_name(info.instruction), info.message.c_str());
+        }else{
+            suite->tests.push_back(info);
+        }
+    }
+}
 
 
 extern "C" void mips_test_begin_suite()
 {
-    if(sg_started){
+    if(sg_suite.started){
         fprintf(stderr, "Error:mips_test_begin_suite - Test suite has already been started\n");
         exit(1);
     }
     
-    // Build up a list of known instruction names
-    for(unsigned i=0; i<sg_instructionsCount; i++){
-        sg_knownInstructions.insert(std::string(sg_instructionsArray[i].instruction));
-    }
+    sg_suite.started=true;
+    sg_suite.startTime=test_clock_t::now();
     
-    sg_started=true;
+    // Reports can be asked for without changing the test program
+    const char *jsonPath=getenv("MIPS_TEST_JSON");
+    const char *junitPath=getenv("MIPS_TEST_JUNIT");
+    mips_test_suite_report_to(&sg_suite, jsonPath, junitPath);
+}
+
+extern "C" mips_test_suite_h mips_test_current_suite()
+{
+    return sg_current ? sg_current : &sg_suite;
+}
+
+extern "C" void mips_test_suite_stream(mips_test_suite_h suite, const char *failuresPath)
+{
+    if(suite->testCount>0){
+        fprintf(stderr, "Error:mips_test_suite_stream - Streaming must be enabled before any tests are started.\n");
+        exit(1);
+    }
+    if(failuresPath){
+        suite->failures=fopen(failuresPath, "wt");
+        if(!suite->failures){
+            fprintf(stderr, "Error:mips_test_suite_stream - Could not open '%s' for writing.\n", failuresPath);
+            exit(1);
+        }
+    }
+    suite->streaming=true;
+}
+  
+extern "C" void mips_test_suite_report_to(mips_test_suite_h suite, const char *jsonPath, const char *junitPath)
+{
+    if(jsonPath){
+        suite->jsonPath=jsonPath;
+    }
+    if(junitPath){
+        suite->junitPath=junitPath;
+    }
 }
   
 extern "C" int mips_test_begin_test(const char *instruction)
 {
-    if(!sg_started){
+    return mips_test_suite_begin_test(mips_test_current_suite(), instruction);
+}
+
+extern "C" int mips_test_suite_begin_test(mips_test_suite_h suite, const char *instruction)
+{
+    if(!suite->started){
         fprintf(stderr, "Error:mips_test_begin_test - Test suite has not been started with mips_test_begin_suite.\n");
         exit(1);
     }
     
-    if(sg_tests.size()>0){
-        if(sg_tests.back().status == -1){
-            fprintf(stderr, "Error:mips_test_begin_test - Attempt to start new test of '%s', but previous test with id %u has not been completed.\n", instruction, sg_tests.back().testId);
+    if(suite->testCount>0){
+        if(suite->current.status == -1){
+            fprintf(stderr, "Error:mips_test_begin_test - Attempt to start new test of '%s', but previous test with id %u has not been completed.\n", instruction, suite->current.testId);
             exit(1);
         }
     }
     
-    int testId=sg_tests.size();
+    int testId=suite->testCount++;
     
-    test_info_t info;
+    test_info_t &info=suite->current;
     info.testId=testId;
     
-    info.instruction=instruction; // We want the string in upper case (shouting!)
-    std::transform(info.instruction.begin(), info.instruction.end(), info.instruction.begin(), ::toupper);
+    std::string name=instruction; // We want the string in upper case (shouting!)
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    
+    bool isNew;
+    info.instruction=mips_test_intern(name, &isNew);
     
-    if(sg_knownInstructions.find(info.instruction)==sg_knownInstructions.end()){
+    // When streaming there may be millions of tests, so only complain once
+    if(info.instruction>=sg_instructionsCount && (isNew || !suite->streaming)){
         fprintf(stderr, "Warning:mips_test_begin_test - Unknown instruction '%s', might want to check the spelling.\n", instruction);
     }
     
     info.status=-1;
-    sg_tests.push_back(info);
+    info.message.clear();
+    info.retired=-1;
     
+    suite->currentStart=test_clock_t::now();
     return testId;
 }
 
 extern "C" void mips_test_end_test(int testId, int passed, const char *msg)
 {
-    if(!sg_started){
+    mips_test_suite_end_test(mips_test_current_suite(), testId, passed, msg);
+}
+
+extern "C" void mips_test_suite_end_test(mips_test_suite_h suite, int testId, int passed, const char *msg)
+{
+    if(!suite->started){
         fprintf(stderr, "Error:mips_test_finish_test - Test suite has not been started with mips_test_begin_suite.");
         exit(1);
     }
     
-    if(sg_tests.size()==0){
+    test_info_t &current=suite->current;
+    if(suite->testCount==0){
         fprintf(stderr, "Error:mips_test_finish_test - No tests have been started.\n");
         exit(1);
     }
-    if(sg_tests.back().testId!=testId){
-        fprintf(stderr, "Error:mips_test_finish_test - Attempt to finish test %u, but last test started was %u.\n", testId, sg_tests.back().testId);
+    if(current.testId!=testId){
+        fprintf(stderr, "Error:mips_test_finish_test - Attempt to finish test %u, but last test started was %u.\n", testId, current.testId);
         exit(1);
     }
-    if(sg_tests.back().status!=-1){
-        fprintf(stderr, "Error:mips_test_finish_test - Attempt to finish test %u, but it already finished with status %u.\n", testId, sg_tests.back().status);
+    if(current.status!=-1){
+        fprintf(stderr, "Error:mips_test_finish_test - Attempt to finish test %u, but it already finished with status %u.\n", testId, current.status);
         exit(1);  
     }
     
-    sg_tests.back().status=passed ? 1 : 0;
+    current.seconds=std::chrono::duration<double>(test_clock_t::now()-suite->currentStart).count();
+    current.status=passed ? 1 : 0;
     if(msg){
-        sg_tests.back().message=msg;
+        current.message=msg;
     }
+    
+    instr_stats_t delta={1, current.status, current.seconds, current.seconds, std::max<int64_t>(0, current.retired)};
+    mips_test_add_statistics(suite, current.instruction, delta);
+    mips_test_keep(suite, current);
+}
+
+extern "C" void mips_test_set_instructions(int testId, uint64_t count)
+{
+    mips_test_suite_set_instructions(mips_test_current_suite(), testId, count);
+}
+
+extern "C" void mips_test_suite_set_instructions(mips_test_suite_h suite, int testId, uint64_t count)
+{
+    if(suite->testCount==0 || suite->current.testId!=testId || suite->current.status!=-1){
+        fprintf(stderr, "Error:mips_test_set_instructions - Test %u is not currently running.\n", testId);
+        exit(1);
+    }
+    suite->current.retired=count;
+}
+
+extern "C" void mips_test_suite_register(mips_test_suite_h suite, mips_test_fn fn, void *arg, uint32_t cbMem)
+{
+    if(suite==sg_current){
+        fprintf(stderr, "Error:mips_test_suite_register - Cannot register functions from within a registered function.\n");
+        exit(1);
+    }
+    if(fn==0){
+        fprintf(stderr, "Error:mips_test_suite_register - Test function is NULL.\n");
+        exit(1);
+    }
+    
+    test_job_t job;
+    job.fn=fn;
+    job.arg=arg;
+    job.cbMem=cbMem;
+    suite->jobs.push_back(job);
+}
+
+/* Runs one registered function against its own suite, with a CPU and
+   RAM from the pool for its memory size. */
+static void mips_test_run_job(const test_job_t &job, mips_pool_h pool, mips_test_suite_impl &local)
+{
+    local.started=true;
+    local.testCount=0;
+    local.failures=0;
+    
+    mips_cpu_h cpu;
+    mips_mem_h mem;
+    if(mips_pool_acquire(pool, &cpu, &mem)){
+        fprintf(stderr, "Error:mips_test_suite_run - Could not create CPU and RAM of %u bytes for test function.\n", job.cbMem);
+        exit(1);
+    }
+    
+    sg_current=&local;
+    job.fn(&local, cpu, mem, job.arg);
+    sg_current=0;
+    
+    mips_pool_release(pool, cpu);
+    
+    if(local.testCount>0 && local.current.status==-1){
+        fprintf(stderr, "Error:mips_test_suite_run - Test function returned while test %u was still running.\n", local.current.testId);
+        exit(1);
+    }
+}
+
+extern "C" void mips_test_suite_run(mips_test_suite_h suite, unsigned threads)
+{
+    if(!suite->started){
+        fprintf(stderr, "Error:mips_test_suite_run - Test suite has not been started with mips_test_begin_suite.\n");
+        exit(1);
+    }
+    if(suite==sg_current){
+        fprintf(stderr, "Error:mips_test_suite_run - Cannot run functions from within a registered function.\n");
+        exit(1);
+    }
+    if(suite->testCount>0 && suite->current.status==-1){
+        fprintf(stderr, "Error:mips_test_suite_run - Test %u has not been completed.\n", suite->current.testId);
+        exit(1);
+    }
+    
+    std::vector<test_job_t> jobs;
+    jobs.swap(suite->jobs);
+    std::vector<mips_test_suite_impl> results(jobs.size());
+    for(unsigned i=0; i<results.size(); i++){
+        results[i].streaming=suite->streaming;  // Only hold on to the failures
+    }
+    
+    if(threads==0){
+        threads=std::thread::hardware_concurrency();
+    }
+    threads=std::max(1u, std::min<unsigned>(threads, jobs.size()));
+    
+    // Functions usually share a handful of memory sizes, so CPUs are
+    // re-used between functions rather than created for each one
+    std::map<uint32_t,mips_pool_h> pools;
+    for(unsigned i=0; i<jobs.size(); i++){
+        if(pools.find(jobs[i].cbMem)==pools.end()){
+            pools[jobs[i].cbMem]=mips_pool_create(jobs[i].cbMem, 0);
+        }
+    }
+    
+    // Each thread keeps taking the next function until there are none left
+    std::atomic<size_t> next(0);
+    auto worker=[&](){
+        size_t i;
+        while((i=next++) < jobs.size()){
+            mips_test_run_job(jobs[i], pools.at(jobs[i].cbMem), results[i]);
+        }
+    };
+    
+    std::vector<std::thread> pool;
+    for(unsigned i=1; i<threads; i++){
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for(unsigned i=0; i<pool.size(); i++){
+        pool[i].join();
+    }
+    for(std::map<uint32_t,mips_pool_h>::iterator it=pools.begin(); it!=pools.end(); ++it){
+        mips_pool_free(it->second);
+    }
+    
+    // Merge in registration order, so that test ids don't depend on scheduling
+    for(unsigned i=0; i<results.size(); i++){
+        const mips_test_suite_impl &local=results[i];
+        
+        for(unsigned j=0; j<local.statistics.size(); j++){
+            mips_test_add_statistics(suite, j, local.statistics[j]);
+        }
+        for(unsigned j=0; j<local.tests.size(); j++){
+            test_info_t info=local.tests[j];
+            info.testId+=suite->testCount;
+            mips_test_keep(suite, info);
+        }
+        suite->testCount+=local.testCount;
+    }
+}
+
+static void mips_test_write_json_string(FILE *dst, const char *str)
+{
+    fputc('"', dst);
+    for(const char *p=str; *p; p++){
+        unsigned char c=*p;
+        if(c=='"' || c=='\\'){
+            fprintf(dst, "\\%c", c);
+        }else if(c<0x20){
+            fprintf(dst, "\\u%04x", c);
+        }else{
+            fputc(c, dst);
+        }
+    }
+    fputc('"', dst);
+}
+
+static void mips_test_write_xml_string(FILE *dst, const char *str)
+{
+    for(const char *p=str; *p; p++){
+        switch(*p){
+        case '&':   fputs("&amp;", dst);    break;
+        case '<':   fputs("&lt;", dst);     break;
+        case '>':   fputs("&gt;", dst);     break;
+        case '"':   fputs("&quot;", dst);   break;
+        case '\'':  fputs("&apos;", dst);   break;
+        default:    fputc(*p, dst);         break;
+        }
+    }
+}
+
+static FILE *mips_test_open_report(const std::string &path)
+{
+    FILE *dst=fopen(path.c_str(), "wt");
+    if(!dst){
+        fprintf(stderr, "Error:mips_test_finish_suite - Could not open report file '%s' for writing.\n", path.c_str());
+        exit(1);
+    }
+    return dst;
+}
+
+/* Per-instruction totals, then every test that was kept. In streaming
+   mode that means only the failures are listed individually. */
+static void mips_test_write_json(mips_test_suite_h suite, const std::map<std::string,unsigned> &order, double seconds)
+{
+    FILE *dst=mips_test_open_report(suite->jsonPath);
+    
+    int passed=0;
+    for(unsigned i=0; i<suite->statistics.size(); i++){
+        passed+=suite->statistics[i].passed;
+    }
+    fprintf(dst, "{\n  \"tests\": %d,\n  \"passed\": %d,\n  \"seconds\": %.9f,\n", suite->testCount, passed, seconds);
+    
+    fprintf(dst, "  \"instructions\": [");
+    std::map<std::string,unsigned>::const_iterator it=order.begin();
+    while(it!=order.end()){
+        const instr_stats_t &stats=suite->statistics[it->second];
+        fprintf(dst, "%s\n    {\"name\": ", it==order.begin() ? "" : ",");
+        mips_test_write_json_string(dst, it->first.c_str());
+        fprintf(dst, ", \"tests\": %d, \"passed\": %d, \"seconds\": %.9f, \"max_seconds\": %.9f, \"retired\": %lld}",
+            stats.tests, stats.passed, stats.seconds, stats.maxSeconds, (long long)stats.retired);
+        ++it;
+    }
+    fprintf(dst, "\n  ],\n");
+    
+    fprintf(dst, "  \"results\": [");
+    for(unsigned i=0; i<suite->tests.size(); i++){
+        const test_info_t &info=suite->tests[i];
+        fprintf(dst, "%s\n    {\"id\": %d, \"instruction\": ", i==0 ? "" : ",", info.testId);
+        mips_test_write_json_string(dst, mips_test_name(info.instruction));
+        fprintf(dst, ", \"passed\": %s, \"seconds\": %.9f", info.status==1 ? "true" : "false", info.seconds);
+        if(info.retired>=0){
+            fprintf(dst, ", \"retired\": %lld", (long long)info.retired);
+        }
+        fprintf(dst, ", \"message\": ");
+        mips_test_write_json_string(dst, info.message.c_str());
+        fprintf(dst, "}");
+    }
+    fprintf(dst, "\n  ]\n}\n");
+    
+    fclose(dst);
+}
+
+/* One testcase per kept test, grouped by instruction using the classname. */
+static void mips_test_write_junit(mips_test_suite_h suite, double seconds)
+{
+    FILE *dst=mips_test_open_report(suite->junitPath);
+    
+    int failures=0;
+    for(unsigned i=0; i<suite->statistics.size(); i++){
+        failures+=suite->statistics[i].tests-suite->statistics[i].passed;
+    }
+    
+    fprintf(dst, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(dst, "<testsuites tests=\"%d\" failures=\"%d\" time=\"%.9f\">\n", suite->testCount, failures, seconds);
+    fprintf(dst, "  <testsuite name=\"mips_test\" tests=\"%d\" failures=\"%d\" time=\"%.9f\">\n", suite->testCount, failures, seconds);
+    for(unsigned i=0; i<suite->tests.size(); i++){
+        const test_info_t &info=suite->tests[i];
+        fprintf(dst, "    <testcase classname=\"");
+        mips_test_write_xml_string(dst, mips_test_name(info.instruction));
+        fprintf(dst, "\" name=\"%d", info.testId);
+        if(!info.message.empty()){
+            fprintf(dst, ": ");
+            mips_test_write_xml_string(dst, info.message.c_str());
+        }
+        fprintf(dst, "\" time=\"%.9f\"", info.seconds);
+        if(info.status==1){
+            fprintf(dst, "/>\n");
+        }else{
+            fprintf(dst, ">\n      <failure message=\"");
+            mips_test_write_xml_string(dst, info.message.c_str());
+            fprintf(dst, "\"/>\n    </testcase>\n");
+        }
+    }
+    fprintf(dst, "  </testsuite>\n</testsuites>\n");
+    
+    fclose(dst);
 }
 
 
 extern "C" void mips_test_end_suite()
 {
-    if(!sg_started){
+    if(!sg_suite.started){
         fprintf(stderr, "Error:mips_test_finish_suite - Test suite has not been started with mips_test_begin_suite.\n");
         exit(1);
     }
-    if(sg_tests.size()==0){
+    if(sg_suite.testCount==0){
         fprintf(stderr, "Error:mips_test_finish_suite - No tests have been executed.\n");
         exit(1);
     }
-    if(sg_tests.back().status==-1){
+    if(sg_suite.current.status==-1){
         fprintf(stderr, "Error:mips_test_finish_suite - The final test has not been completed yet.\n");
         exit(1);
     }
     
-    // Now we will go through an collect some statistics about what happened
-    
-    // Build a map from instruction name to a pair of (tests,passed)
-    typedef std::map<std::string, std::pair<int,int> > stats_t;
-    stats_t statistics;
+    if(sg_suite.failures){
+        fclose(sg_suite.failures);
+        sg_suite.failures=0;
+    }
     
-    for(unsigned i=0; i<sg_tests.size(); i++){
-        test_info_t info=sg_tests[i];
-        
-        statistics[info.instruction].first++;   // count all tests
-        if(info.status==1){
-            statistics[info.instruction].second++;  // count the ones that passed
+    // The statistics were collected as the tests ran, we just need
+    // to list the instructions that were tested in name order.
+    typedef std::map<std::string, unsigned> order_t;
+    order_t order;
+    for(unsigned i=0; i<sg_suite.statistics.size(); i++){
+        if(sg_suite.statistics[i].tests>0){
+            order[mips_test_name(i)]=i;
         }
     }
     
@@ -207,11 +637,11 @@ extern "C" void mips_test_end_suite()
     int totalPartiallyWorking=0;
     int totalFullyWorking=0;
     
-    stats_t::const_iterator it=statistics.begin();
-    while(it!=statistics.end()){
+    order_t::const_iterator it=order.begin();
+    while(it!=order.end()){
         std::string name=it->first;
-        int total=it->second.first;
-        int passed=it->second.second;
+        int total=sg_suite.statistics[it->second].tests;
+        int passed=sg_suite.statistics[it->second].passed;
         
         totalTested++;
         if(passed==0){
@@ -224,7 +654,7 @@ extern "C" void mips_test_end_suite()
             
         fprintf(stderr, "|%12s |   %4u |   %4u |  %5.1f%% |\n", name.c_str(), total, passed, 100.0*passed/(double)total);
         
-        if(sg_knownInstructions.find(name)==sg_knownInstructions.end()){
+        if(it->second>=sg_instructionsCount){
             fprintf(stderr, "+ Warning: previous instruction not known +\n");
         }
         
@@ -237,4 +667,12 @@ extern "C" void mips_test_end_suite()
     fprintf(stderr, "Fully working :            %3u (%5.1f%%)\n", totalFullyWorking, 100.0*totalFullyWorking/(double)totalTested);
     fprintf(stderr, "Partially working :        %3u (%5.1f%%)\n", totalPartiallyWorking, 100.0*totalPartiallyWorking/(double)totalTested);
     fprintf(stderr, "Not working at all :       %3u (%5.1f%%)\n", totalNotWorking, 100.0*totalNotWorking/(double)totalTested);
+    
+    double seconds=std::chrono::duration<double>(test_clock_t::now()-sg_suite.startTime).count();
+    if(!sg_suite.jsonPath.empty()){
+        mips_test_write_json(&sg_suite, order, seconds);
+    }
+    if(!sg_suite.junitPath.empty()){
+        mips_test_write_junit(&sg_suite, seconds);
+    }
 }
@@ -0,0 +1,94 @@
+/* Translates a binary image into C++, which can be compiled into a
+   library and loaded with mips_aot_open (see mips_aot.h).
+
+   Usage:
+
+       tools/mips_aot [-a address] [-e pc]... [-o output.cpp] image.bin
+
+       -a address      Load address of the image (default 0)
+       -e pc           Extra entry point, can be repeated. The load address
+                       is always one
+       -o file         Where to write the C++ (default stdout)
+
+   The translation itself is done by mips_aot_translate, which is also
+   what mips_aot_cache_load uses.
+*/
+#include "mips.h"
+
+#include <vector>
+#include <string.h>
+
+static uint32_t aot_parse_number(const char *text)
+{
+    char *end;
+    unsigned long v=strtoul(text, &end, 0);
+    if(*text==0 || *end!=0){
+        fprintf(stderr, "Error: '%s' is not a number.\n", text);
+        exit(1);
+    }
+    return (uint32_t)v;
+}
+
+static void aot_usage()
+{
+    fprintf(stderr, "Usage: mips_aot [-a address] [-e pc]... [-o output.cpp] image.bin\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t base=0;
+    std::vector<uint32_t> entries;
+    const char *imagePath=0, *outputPath=0;
+
+    for(int i=1; i<argc; i++){
+        if(argv[i][0]!='-'){
+            if(imagePath){
+                aot_usage();
+            }
+            imagePath=argv[i];
+            continue;
+        }
+        if(i+1>=argc){
+            aot_usage();
+        }
+        if(!strcmp(argv[i], "-a")){
+            base=aot_parse_number(argv[++i]);
+        }else if(!strcmp(argv[i], "-e")){
+            entries.push_back(aot_parse_number(argv[++i]));
+        }else if(!strcmp(argv[i], "-o")){
+            outputPath=argv[++i];
+        }else{
+            aot_usage();
+        }
+    }
+    if(!imagePath || (base&3)){
+        aot_usage();
+    }
+
+    FILE *src=fopen(imagePath, "rb");
+    if(!src){
+        fprintf(stderr, "Error: cannot load image '%s'.\n", imagePath);
+        exit(1);
+    }
+    std::vector<uint8_t> image;
+    uint8_t buffer[4096];
+    size_t got;
+    while((got=fread(buffer, 1, sizeof(buffer), src))>0){
+        image.insert(image.end(), buffer, buffer+got);
+    }
+    fclose(src);
+
+    FILE *dst = outputPath ? fopen(outputPath, "w") : stdout;
+    if(!dst){
+        fprintf(stderr, "Error: cannot write to '%s'.\n", outputPath);
+        exit(1);
+    }
+    mips_error err=mips_aot_translate(dst, imagePath, base, image.empty() ? 0 : &image[0], image.size(),
+        entries.size(), entries.empty() ? 0 : &entries[0]);
+    if(err || (outputPath && fclose(dst))){
+        fprintf(stderr, "Error: cannot write to '%s'.\n", outputPath);
+        exit(1);
+    }
+    return 0;
+}
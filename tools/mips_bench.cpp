@@ -0,0 +1,555 @@
+/* Measures how fast a CPU implementation runs.
+
+   There are three kinds of benchmark:
+
+   - Instruction classes (alu, shift, loadstore, branch, muldiv): a loop
+     whose body is 32 instructions of one class, stepped for a fixed
+     number of instructions.
+
+   - Memory API (mem_read, mem_write): word transfers straight through
+     mips_mem_read and mips_mem_write, with no CPU involved.
+
+   - Workloads (addu, fibonacci): repeated calls to the f_addu fragment
+     in the same way as run_addu, and the recursive f_fibonacci fragment
+     run to completion with a larger n than run_fibonacci uses.
+
+   Each benchmark is run a few times to warm up, then timed over a number
+   of repetitions. Pinning to one core (-p) stops the scheduler moving
+   the process part way through, which is most of the run-to-run noise
+   on an otherwise idle machine. The mean, standard deviation and range of the host
+   nanoseconds per unit of work (guest instruction or memory access)
+   are printed, along with millions of units per second. The same
+   numbers are written as JSON, so that they can be kept and compared
+   between versions.
+
+   Usage:
+
+       tools/mips_bench [-r reps] [-w warmups] [-p core] [-n instructions]
+                        [-F fib_n] [-f fragments_dir] [-o results.json] [NAME ...]
+
+   Listing benchmark names runs just those. Without -o the JSON goes to
+   stdout. Two JSON files can be compared with tools/mips_bench_compare.
+*/
+#include "mips.h"
+
+#include "../fragments/f_fibonacci.c"
+#include "../fragments/f_addu.c"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define BENCH_RAM_SIZE      0x100000u
+#define BENCH_DATA_BASE     0x80000u
+#define BENCH_BODY_LENGTH   32
+
+// Register conventions used by the generated loops
+#define BENCH_COUNTER   2       // Loop counter, never reaches zero
+#define BENCH_BASE      16      // Points at the data area
+
+struct bench_options_t
+{
+    unsigned reps;
+    unsigned warmups;
+    uint64_t instructions;  // Guest instructions per repetition of each class benchmark
+    uint32_t fibN;
+    std::string fragments;  // Directory holding the fragment binaries
+};
+
+struct bench_result_t
+{
+    std::string name;
+    std::string unit;
+    uint64_t work;                  // Units of work per repetition
+    std::vector<double> seconds;    // One per repetition
+};
+
+/* Runs one repetition, putting the amount of work done in `work`.
+   Returns false if the CPU reported an error. */
+typedef bool (*bench_fn)(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds);
+
+static double bench_elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+static uint32_t enc_r(uint32_t fn, uint32_t rs, uint32_t rt, uint32_t rd, uint32_t shamt=0)
+{
+    return (rs<<21) | (rt<<16) | (rd<<11) | (shamt<<6) | fn;
+}
+
+static uint32_t enc_i(uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t imm)
+{
+    return (opcode<<26) | (rs<<21) | (rt<<16) | (imm&0xFFFF);
+}
+
+static void bench_write_code(mips_mem_h mem, const std::vector<uint32_t> &code)
+{
+    for(unsigned i=0; i<code.size(); i++){
+        uint8_t bytes[4]={ uint8_t(code[i]>>24), uint8_t(code[i]>>16), uint8_t(code[i]>>8), uint8_t(code[i]) };
+        mips_mem_write(mem, 4*i, 4, bytes);
+    }
+}
+
+/* Wraps a loop body into an endless loop at address 0, and steps it. */
+static bool bench_run_loop(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, const std::vector<uint32_t> &body, uint64_t &work, double &seconds)
+{
+    std::vector<uint32_t> code(body);
+    code.push_back(enc_i(0x09, BENCH_COUNTER, BENCH_COUNTER, -1));          // addiu $2,$2,-1
+    code.push_back(enc_i(0x05, BENCH_COUNTER, 0, -(int)(code.size()+1)));    // bne $2,$0,0
+    code.push_back(0);                                                      // nop
+    bench_write_code(mem, code);
+
+    mips_cpu_reset(cpu);
+    for(unsigned i=8; i<16; i++){
+        mips_cpu_set_register(cpu, i, 0x01234567u*i+1);
+    }
+    mips_cpu_set_register(cpu, BENCH_COUNTER, 0x7FFFFFFF);
+    mips_cpu_set_register(cpu, BENCH_BASE, BENCH_DATA_BASE);
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    for(uint64_t i=0; i<opts.instructions; i++){
+        mips_error err=mips_cpu_step(cpu);
+        if(err){
+            fprintf(stderr, "  CPU returned error 0x%x after %llu instructions.\n", err, (unsigned long long)i);
+            return false;
+        }
+    }
+    seconds=bench_elapsed(start);
+    work=opts.instructions;
+    return true;
+}
+
+static bool bench_alu(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    static const uint32_t fns[]={ 0x21, 0x23, 0x24, 0x25, 0x26, 0x2A, 0x2B };    // addu subu and or xor slt sltu
+    static const uint32_t ops[]={ 0x09, 0x0C, 0x0D, 0x0E, 0x0A, 0x0B, 0x0F };    // addiu andi ori xori slti sltiu lui
+    std::vector<uint32_t> body;
+    for(unsigned i=0; i<BENCH_BODY_LENGTH; i++){
+        uint32_t d=8+i%8, s=8+(i+3)%8, t=8+(i+5)%8;
+        if(i%2){
+            body.push_back(enc_i(ops[i/2%7], s, d, 0x1234+i));
+        }else{
+            body.push_back(enc_r(fns[i/2%7], s, t, d));
+        }
+    }
+    return bench_run_loop(opts, mem, cpu, body, work, seconds);
+}
+
+static bool bench_shift(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    static const uint32_t fns[]={ 0x00, 0x02, 0x03, 0x04, 0x06, 0x07 };   // sll srl sra sllv srlv srav
+    std::vector<uint32_t> body;
+    for(unsigned i=0; i<BENCH_BODY_LENGTH; i++){
+        uint32_t d=8+i%8, s=8+(i+3)%8, t=8+(i+5)%8;
+        uint32_t fn=fns[i%6];
+        body.push_back(enc_r(fn, fn&4 ? s : 0, t, d, fn&4 ? 0 : i%32));
+    }
+    return bench_run_loop(opts, mem, cpu, body, work, seconds);
+}
+
+static bool bench_loadstore(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    std::vector<uint32_t> body;
+    for(unsigned i=0; i<BENCH_BODY_LENGTH; i+=8){
+        uint32_t offset=16*i;
+        body.push_back(enc_i(0x2B, BENCH_BASE, 8+i/8, offset));     // sw
+        body.push_back(enc_i(0x29, BENCH_BASE, 9, offset+4));       // sh
+        body.push_back(enc_i(0x28, BENCH_BASE, 10, offset+7));      // sb
+        body.push_back(enc_i(0x23, BENCH_BASE, 11, offset));        // lw
+        body.push_back(enc_i(0x21, BENCH_BASE, 12, offset+4));      // lh
+        body.push_back(enc_i(0x25, BENCH_BASE, 13, offset+6));      // lhu
+        body.push_back(enc_i(0x20, BENCH_BASE, 14, offset+7));      // lb
+        body.push_back(enc_i(0x24, BENCH_BASE, 15, offset+5));      // lbu
+    }
+    return bench_run_loop(opts, mem, cpu, body, work, seconds);
+}
+
+static bool bench_branch(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    // Alternately taken and not taken, each with a nop in the delay slot
+    std::vector<uint32_t> body;
+    for(unsigned i=0; i<BENCH_BODY_LENGTH; i+=2){
+        if(i%4){
+            body.push_back(enc_i(0x05, 0, 0, 1));   // bne $0,$0,+1
+        }else{
+            body.push_back(enc_i(0x04, 0, 0, 1));   // beq $0,$0,+1
+        }
+        body.push_back(0);
+    }
+    return bench_run_loop(opts, mem, cpu, body, work, seconds);
+}
+
+static bool bench_muldiv(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    // $8 and $9 are only read, so the divisor is never zero
+    std::vector<uint32_t> body;
+    for(unsigned i=0; i<BENCH_BODY_LENGTH; i+=8){
+        body.push_back(enc_r(0x18, 8, 9, 0));   // mult
+        body.push_back(enc_r(0x12, 0, 0, 10));  // mflo
+        body.push_back(enc_r(0x19, 8, 9, 0));   // multu
+        body.push_back(enc_r(0x10, 0, 0, 11));  // mfhi
+        body.push_back(enc_r(0x1A, 8, 9, 0));   // div
+        body.push_back(enc_r(0x12, 0, 0, 12));  // mflo
+        body.push_back(enc_r(0x1B, 9, 8, 0));   // divu
+        body.push_back(enc_r(0x10, 0, 0, 13));  // mfhi
+    }
+    return bench_run_loop(opts, mem, cpu, body, work, seconds);
+}
+
+static bool bench_mem_access(const bench_options_t &opts, mips_mem_h mem, bool write, uint64_t &work, double &seconds)
+{
+    uint8_t buffer[4]={1, 2, 3, 4};
+    uint32_t mask=BENCH_RAM_SIZE-4;
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    for(uint64_t i=0; i<opts.instructions; i++){
+        uint32_t address=(uint32_t)(i*4) & mask;
+        mips_error err = write ? mips_mem_write(mem, address, 4, buffer) : mips_mem_read(mem, address, 4, buffer);
+        if(err){
+            fprintf(stderr, "  Memory returned error 0x%x.\n", err);
+            return false;
+        }
+    }
+    seconds=bench_elapsed(start);
+    work=opts.instructions;
+    return true;
+}
+
+static bool bench_mem_read(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h, uint64_t &work, double &seconds)
+{
+    return bench_mem_access(opts, mem, false, work, seconds);
+}
+
+static bool bench_mem_write(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h, uint64_t &work, double &seconds)
+{
+    return bench_mem_access(opts, mem, true, work, seconds);
+}
+
+/* Loads one of the fragment binaries at address 0. */
+static bool bench_load_fragment(const bench_options_t &opts, mips_mem_h mem, const char *name)
+{
+    std::string path=opts.fragments+"/"+name;
+    FILE *src=fopen(path.c_str(), "rb");
+    if(!src){
+        fprintf(stderr, "  Cannot load '%s', use -f to give the path to the fragments directory.\n", path.c_str());
+        return false;
+    }
+    uint8_t bytes[4];
+    uint32_t offset=0;
+    while(1==fread(bytes, 4, 1, src)){
+        mips_mem_write(mem, offset, 4, bytes);
+        offset+=4;
+    }
+    fclose(src);
+    return true;
+}
+
+/* Calls f_addu over and over. Nearly all of the time goes on setting up
+   and reading back registers, which is what a test harness does. */
+static bool bench_addu(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    if(!bench_load_fragment(opts, mem, "f_addu-mips.bin")){
+        return false;
+    }
+
+    const uint32_t sentinelPC=0x10000000;
+    uint64_t calls=opts.instructions/2;
+    uint32_t check=0, checkRef=0;
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    for(uint64_t i=0; i<calls; i++){
+        uint32_t a=(uint32_t)i, b=(uint32_t)(i*7), sum;
+        mips_cpu_set_pc(cpu, 0);
+        mips_cpu_set_register(cpu, 31, sentinelPC);
+        mips_cpu_set_register(cpu, 4, a);
+        mips_cpu_set_register(cpu, 5, b);
+        mips_error err=mips_cpu_step(cpu);
+        if(!err){
+            err=mips_cpu_step(cpu);
+        }
+        if(err){
+            fprintf(stderr, "  CPU returned error 0x%x.\n", err);
+            return false;
+        }
+        err=mips_cpu_get_register(cpu, 2, &sum);
+        if(err){
+            fprintf(stderr, "  Couldn't read $v0, error 0x%x.\n", err);
+            return false;
+        }
+        check+=sum;
+        checkRef+=f_addu(a, b);
+    }
+    seconds=bench_elapsed(start);
+
+    if(check!=checkRef){
+        fprintf(stderr, "  f_addu gave the wrong answers.\n");
+        return false;
+    }
+    work=2*calls;
+    return true;
+}
+
+static bool bench_fibonacci(const bench_options_t &opts, mips_mem_h mem, mips_cpu_h cpu, uint64_t &work, double &seconds)
+{
+    if(!bench_load_fragment(opts, mem, "f_fibonacci-mips.bin")){
+        return false;
+    }
+
+    const uint32_t sentinelPC=0x10000000;
+
+    mips_cpu_reset(cpu);
+    mips_cpu_set_register(cpu, 31, sentinelPC);
+    mips_cpu_set_register(cpu, 4, opts.fibN);
+    mips_cpu_set_register(cpu, 29, BENCH_RAM_SIZE);
+
+    uint64_t steps=0;
+    uint32_t pc=0;
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    while(pc!=sentinelPC){
+        mips_error err=mips_cpu_step(cpu);
+        if(err){
+            fprintf(stderr, "  CPU returned error 0x%x after %llu instructions.\n", err, (unsigned long long)steps);
+            return false;
+        }
+        ++steps;
+        mips_cpu_get_pc(cpu, &pc);
+    }
+    seconds=bench_elapsed(start);
+
+    uint32_t got;
+    mips_error err=mips_cpu_get_register(cpu, 2, &got);
+    if(err){
+        fprintf(stderr, "  Couldn't read $v0, error 0x%x.\n", err);
+        return false;
+    }
+    if(got!=f_fibonacci(opts.fibN)){
+        fprintf(stderr, "  fib(%u) = %u, expected = %u\n", opts.fibN, got, f_fibonacci(opts.fibN));
+        return false;
+    }
+    work=steps;
+    return true;
+}
+
+struct bench_info_t
+{
+    const char *name;
+    const char *unit;
+    bench_fn fn;
+};
+
+static const bench_info_t sg_benchmarks[]=
+{
+    {"alu",         "instruction",  bench_alu},
+    {"shift",       "instruction",  bench_shift},
+    {"loadstore",   "instruction",  bench_loadstore},
+    {"branch",      "instruction",  bench_branch},
+    {"muldiv",      "instruction",  bench_muldiv},
+    {"mem_read",    "access",       bench_mem_read},
+    {"mem_write",   "access",       bench_mem_write},
+    {"addu",        "instruction",  bench_addu},
+    {"fibonacci",   "instruction",  bench_fibonacci}
+};
+static const unsigned sg_benchmarkCount = sizeof(sg_benchmarks)/sizeof(sg_benchmarks[0]);
+
+
+/////////////////////////////////////////////////////////////////////
+
+struct bench_stats_t
+{
+    double mean, stddev, median, min, max;
+};
+
+static bench_stats_t bench_stats(const std::vector<double> &xs)
+{
+    bench_stats_t s={0, 0, 0, xs[0], xs[0]};
+    for(unsigned i=0; i<xs.size(); i++){
+        s.mean+=xs[i];
+        s.min=std::min(s.min, xs[i]);
+        s.max=std::max(s.max, xs[i]);
+    }
+    s.mean/=xs.size();
+    if(xs.size()>1){
+        for(unsigned i=0; i<xs.size(); i++){
+            s.stddev+=(xs[i]-s.mean)*(xs[i]-s.mean);
+        }
+        s.stddev=sqrt(s.stddev/(xs.size()-1));
+    }
+    std::vector<double> sorted(xs);
+    std::sort(sorted.begin(), sorted.end());
+    unsigned n=sorted.size();
+    s.median = n%2 ? sorted[n/2] : (sorted[n/2-1]+sorted[n/2])/2;
+    return s;
+}
+
+static void bench_write_stats(FILE *dst, const char *name, const bench_stats_t &s)
+{
+    fprintf(dst, "      \"%s\": {\"mean\": %.6g, \"stddev\": %.6g, \"median\": %.6g, \"min\": %.6g, \"max\": %.6g}", name, s.mean, s.stddev, s.median, s.min, s.max);
+}
+
+static void bench_write_json(FILE *dst, const bench_options_t &opts, int pinned, const std::vector<bench_result_t> &results)
+{
+    fprintf(dst, "{\n  \"reps\": %u,\n  \"warmups\": %u,\n  \"pinned_core\": %d,\n  \"fib_n\": %u,\n  \"benchmarks\": [\n",
+        opts.reps, opts.warmups, pinned, opts.fibN);
+    for(unsigned i=0; i<results.size(); i++){
+        const bench_result_t &r=results[i];
+        std::vector<double> ns, mps;
+        for(unsigned j=0; j<r.seconds.size(); j++){
+            ns.push_back(r.seconds[j]*1e9/r.work);
+            mps.push_back(r.work/r.seconds[j]/1e6);
+        }
+        fprintf(dst, "    {\n      \"name\": \"%s\",\n      \"unit\": \"%s\",\n      \"count\": %llu,\n",
+            r.name.c_str(), r.unit.c_str(), (unsigned long long)r.work);
+        fprintf(dst, "      \"seconds\": [");
+        for(unsigned j=0; j<r.seconds.size(); j++){
+            fprintf(dst, "%s%.6g", j ? ", " : "", r.seconds[j]);
+        }
+        fprintf(dst, "],\n");
+        bench_write_stats(dst, "ns_per_unit", bench_stats(ns));
+        fprintf(dst, ",\n");
+        bench_write_stats(dst, "million_per_second", bench_stats(mps));
+        fprintf(dst, "\n    }%s\n", i+1<results.size() ? "," : "");
+    }
+    fprintf(dst, "  ]\n}\n");
+}
+
+/* Keeps the process on one core. Returns the core, or -1 if that
+   isn't possible here. */
+static int bench_pin(int core)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if(0==sched_setaffinity(0, sizeof(set), &set)){
+        return core;
+    }
+#endif
+    fprintf(stderr, "Warning: couldn't pin to core %d, timings may be noisier.\n", core);
+    return -1;
+}
+
+static void bench_usage()
+{
+    fprintf(stderr, "Usage: mips_bench [-r reps] [-w warmups] [-p core] [-n instructions] [-F fib_n] [-f fragments_dir] [-o results.json] [NAME ...]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options_t opts;
+    opts.reps=5;
+    opts.warmups=1;
+    opts.instructions=10000000;
+    opts.fibN=25;
+    opts.fragments="fragments";
+    const char *jsonPath=0;
+    int pinned=-1;
+    std::vector<std::string> chosen;
+
+    for(int i=1; i<argc; i++){
+        std::string arg=argv[i];
+        if(arg[0]=='-'){
+            if(i+1>=argc){
+                bench_usage();
+            }
+            const char *value=argv[++i];
+            if(arg=="-r"){
+                opts.reps=std::max(1ul, strtoul(value, 0, 0));
+            }else if(arg=="-w"){
+                opts.warmups=strtoul(value, 0, 0);
+            }else if(arg=="-p"){
+                pinned=bench_pin(atoi(value));
+            }else if(arg=="-n"){
+                opts.instructions=std::max(1ull, strtoull(value, 0, 0));
+            }else if(arg=="-F"){
+                opts.fibN=strtoul(value, 0, 0);
+            }else if(arg=="-f"){
+                opts.fragments=value;
+            }else if(arg=="-o"){
+                jsonPath=value;
+            }else{
+                bench_usage();
+            }
+        }else{
+            chosen.push_back(arg);
+        }
+    }
+
+    std::vector<bench_result_t> results;
+    bool failed=false;
+
+    fprintf(stderr, "| Benchmark   |   ns/unit (+- stddev)   |  M/sec |\n");
+    fprintf(stderr, "+-------------+-------------------------+--------+\n");
+    for(unsigned i=0; i<sg_benchmarkCount; i++){
+        const bench_info_t &info=sg_benchmarks[i];
+        if(!chosen.empty() && std::find(chosen.begin(), chosen.end(), info.name)==chosen.end()){
+            continue;
+        }
+
+        // Each benchmark gets fresh state, so earlier ones can't affect it
+        mips_mem_h mem=mips_mem_create_ram(BENCH_RAM_SIZE);
+        mips_cpu_h cpu=mips_cpu_create(mem);
+        if(!cpu){
+            fprintf(stderr, "Couldn't create CPU.\n");
+            exit(1);
+        }
+
+        bench_result_t r;
+        r.name=info.name;
+        r.unit=info.unit;
+        r.work=0;
+
+        uint64_t work;
+        double seconds;
+        bool ok=true;
+        for(unsigned j=0; ok && j<opts.warmups; j++){
+            ok=info.fn(opts, mem, cpu, work, seconds);
+        }
+        for(unsigned j=0; ok && j<opts.reps; j++){
+            ok=info.fn(opts, mem, cpu, work, seconds);
+            r.work=work;
+            r.seconds.push_back(seconds);
+        }
+
+        mips_cpu_free(cpu);
+        mips_mem_free(mem);
+
+        if(!ok){
+            fprintf(stderr, "|%12s | failed\n", info.name);
+            failed=true;
+            continue;
+        }
+
+        std::vector<double> ns;
+        for(unsigned j=0; j<r.seconds.size(); j++){
+            ns.push_back(r.seconds[j]*1e9/r.work);
+        }
+        bench_stats_t s=bench_stats(ns);
+        fprintf(stderr, "|%12s | %10.2f (+- %7.2f) | %6.1f |\n", info.name, s.mean, s.stddev, 1e3/s.mean);
+        results.push_back(r);
+    }
+    fprintf(stderr, "+-------------+-------------------------+--------+\n");
+
+    FILE *dst=stdout;
+    if(jsonPath){
+        dst=fopen(jsonPath, "wt");
+        if(!dst){
+            fprintf(stderr, "Error: couldn't open '%s' for writing.\n", jsonPath);
+            exit(1);
+        }
+    }
+    bench_write_json(dst, opts, pinned, results);
+    if(jsonPath){
+        fclose(dst);
+    }
+
+    return failed ? 1 : 0;
+}
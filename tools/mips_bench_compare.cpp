@@ -0,0 +1,326 @@
+/* Compares two sets of results written by tools/mips_bench, and fails
+   if any benchmark got significantly slower.
+
+   Usage:
+
+       tools/mips_bench_compare [-t percent] baseline.json current.json
+
+   Each repetition of a benchmark gives one sample of ns per unit. For
+   each benchmark the median of the samples is taken, along with a 95%
+   confidence interval for the median. The interval comes from order
+   statistics, so nothing is assumed about how the timings are
+   distributed, which matters because timing noise is very skewed.
+
+   A benchmark counts as slower when its interval lies entirely above
+   the baseline's interval and the medians differ by more than the
+   threshold (default 3%). Speed-ups are reported the same way, but
+   never fail. The exit code is 1 if anything got slower, 2 if the files
+   couldn't be read, otherwise 0.
+
+   The interval needs enough samples to be useful. With fewer than six
+   it is just the whole range, so baselines are best recorded with
+   something like `-r 11`.
+*/
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct compare_samples_t
+{
+    std::vector<double> ns;     // ns per unit, one per repetition
+};
+
+typedef std::map<std::string, compare_samples_t> compare_results_t;
+
+
+/////////////////////////////////////////////////////////////////////
+// Reading results
+//
+// Only enough JSON is understood to pull out each benchmark's name,
+// count, and seconds array; everything else in the file is skipped.
+
+struct compare_parser_t
+{
+    const char *p;
+    bool ok;
+
+    void skip_ws()
+    {
+        while(*p==' ' || *p=='\t' || *p=='\n' || *p=='\r'){
+            p++;
+        }
+    }
+
+    bool expect(char c)
+    {
+        skip_ws();
+        if(*p!=c){
+            ok=false;
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    std::string string()
+    {
+        std::string res;
+        if(!expect('"')){
+            return res;
+        }
+        while(*p && *p!='"'){
+            if(*p=='\\' && p[1]){
+                p++;
+            }
+            res+=*p++;
+        }
+        expect('"');
+        return res;
+    }
+
+    double number()
+    {
+        skip_ws();
+        char *end;
+        double res=strtod(p, &end);
+        if(end==p){
+            ok=false;
+        }
+        p=end;
+        return res;
+    }
+
+    /* Skips any value. */
+    void value()
+    {
+        skip_ws();
+        if(*p=='"'){
+            string();
+        }else if(*p=='{' || *p=='['){
+            char close = *p=='{' ? '}' : ']';
+            p++;
+            skip_ws();
+            while(ok && *p!=close){
+                if(close=='}'){
+                    string();
+                    expect(':');
+                }
+                value();
+                skip_ws();
+                if(*p==','){
+                    p++;
+                }else if(*p!=close){
+                    ok=false;
+                }
+            }
+            expect(close);
+        }else if(*p=='t' || *p=='f' || *p=='n'){
+            while(*p>='a' && *p<='z'){
+                p++;
+            }
+        }else{
+            number();
+        }
+    }
+
+    void benchmark(compare_results_t &results)
+    {
+        std::string name;
+        double count=0;
+        std::vector<double> seconds;
+
+        expect('{');
+        skip_ws();
+        while(ok && *p!='}'){
+            std::string key=string();
+            expect(':');
+            if(key=="name"){
+                name=string();
+            }else if(key=="count"){
+                count=number();
+            }else if(key=="seconds"){
+                expect('[');
+                skip_ws();
+                while(ok && *p!=']'){
+                    seconds.push_back(number());
+                    skip_ws();
+                    if(*p==','){
+                        p++;
+                    }
+                }
+                expect(']');
+            }else{
+                value();
+            }
+            skip_ws();
+            if(*p==','){
+                p++;
+                skip_ws();
+            }
+        }
+        expect('}');
+
+        if(ok && count>0 && !seconds.empty()){
+            compare_samples_t &s=results[name];
+            for(unsigned i=0; i<seconds.size(); i++){
+                s.ns.push_back(seconds[i]*1e9/count);
+            }
+        }
+    }
+
+    void top(compare_results_t &results)
+    {
+        expect('{');
+        skip_ws();
+        while(ok && *p!='}'){
+            std::string key=string();
+            expect(':');
+            if(key=="benchmarks"){
+                expect('[');
+                skip_ws();
+                while(ok && *p!=']'){
+                    benchmark(results);
+                    skip_ws();
+                    if(*p==','){
+                        p++;
+                        skip_ws();
+                    }
+                }
+                expect(']');
+            }else{
+                value();
+            }
+            skip_ws();
+            if(*p==','){
+                p++;
+                skip_ws();
+            }
+        }
+        expect('}');
+    }
+};
+
+static void compare_load(const char *path, compare_results_t &results)
+{
+    FILE *src=fopen(path, "rb");
+    if(!src){
+        fprintf(stderr, "Error: couldn't open '%s'.\n", path);
+        exit(2);
+    }
+    std::string text;
+    char buffer[4096];
+    size_t got;
+    while((got=fread(buffer, 1, sizeof(buffer), src))>0){
+        text.append(buffer, got);
+    }
+    fclose(src);
+
+    compare_parser_t parser={text.c_str(), true};
+    parser.top(results);
+    if(!parser.ok){
+        fprintf(stderr, "Error: '%s' is not a results file from mips_bench (near offset %u).\n",
+            path, (unsigned)(parser.p-text.c_str()));
+        exit(2);
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Statistics
+
+struct compare_interval_t
+{
+    double median, low, high;
+};
+
+/* Median and a distribution-free 95% interval for it. The interval runs
+   from the k-th smallest to the k-th largest sample, with k the largest
+   rank such that P(Binomial(n, 1/2) < k) <= 2.5%. */
+static compare_interval_t compare_interval(std::vector<double> xs)
+{
+    std::sort(xs.begin(), xs.end());
+    unsigned n=xs.size();
+
+    compare_interval_t res;
+    res.median = n%2 ? xs[n/2] : (xs[n/2-1]+xs[n/2])/2;
+
+    unsigned k=1;
+    double tail=pow(0.5, n);    // P(B <= 0)
+    double term=tail;
+    while(k<n/2){
+        term=term*(n-k+1)/k;    // P(B == k)
+        if(tail+term>0.025){
+            break;
+        }
+        tail+=term;
+        k++;
+    }
+    res.low=xs[k-1];
+    res.high=xs[n-k];
+    return res;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+    double threshold=3;
+    std::vector<const char *> paths;
+
+    for(int i=1; i<argc; i++){
+        if(!strcmp(argv[i], "-t") && i+1<argc){
+            threshold=strtod(argv[++i], 0);
+        }else{
+            paths.push_back(argv[i]);
+        }
+    }
+    if(paths.size()!=2){
+        fprintf(stderr, "Usage: mips_bench_compare [-t percent] baseline.json current.json\n");
+        exit(2);
+    }
+
+    compare_results_t base, curr;
+    compare_load(paths[0], base);
+    compare_load(paths[1], curr);
+
+    unsigned slower=0, faster=0;
+
+    fprintf(stderr, "| Benchmark   | baseline ns/unit [95%% CI]   | current ns/unit [95%% CI]    |   delta | verdict\n");
+    fprintf(stderr, "+-------------+-----------------------------+-----------------------------+---------+--------\n");
+    for(compare_results_t::const_iterator it=curr.begin(); it!=curr.end(); ++it){
+        compare_results_t::const_iterator bit=base.find(it->first);
+        compare_interval_t c=compare_interval(it->second.ns);
+        if(bit==base.end()){
+            fprintf(stderr, "|%12s | %27s | %8.2f [%7.2f, %7.2f] | %7s | new\n",
+                it->first.c_str(), "-", c.median, c.low, c.high, "-");
+            continue;
+        }
+        compare_interval_t b=compare_interval(bit->second.ns);
+
+        double delta=100*(c.median-b.median)/b.median;
+        const char *verdict="same";
+        if(c.low>b.high && delta>threshold){
+            verdict="SLOWER";
+            slower++;
+        }else if(c.high<b.low && -delta>threshold){
+            verdict="faster";
+            faster++;
+        }
+        fprintf(stderr, "|%12s | %8.2f [%7.2f, %7.2f] | %8.2f [%7.2f, %7.2f] | %+6.1f%% | %s\n",
+            it->first.c_str(), b.median, b.low, b.high, c.median, c.low, c.high, delta, verdict);
+    }
+    for(compare_results_t::const_iterator bit=base.begin(); bit!=base.end(); ++bit){
+        if(curr.find(bit->first)==curr.end()){
+            fprintf(stderr, "|%12s | (in the baseline, but not run)\n", bit->first.c_str());
+        }
+    }
+    fprintf(stderr, "\n%u slower, %u faster (threshold %.1f%%).\n", slower, faster, threshold);
+
+    return slower ? 1 : 0;
+}
@@ -0,0 +1,770 @@
+/* A randomised tester for CPU implementations.
+
+   Each case is one randomly chosen instruction, with random operand
+   fields, register values and data memory. The case is run on the
+   CPU being tested (through mips_cpu.h) and on the small reference
+   model in this file, and the outcomes are compared: the error
+   returned, the registers, the pc, and the whole of memory. The first
+   mismatch found for each instruction is shrunk down to a simpler
+   case which still fails, then printed.
+
+   Usage:
+
+       tools/mips_fuzz [-n cases] [-d seconds] [-j threads] [-s seed] [INSTR ...]
+
+   By default one million cases are run, spread across one thread per
+   core, covering every instruction in mips_isa.h. Listing instruction
+   names restricts it to those. The exit code is non-zero if any
+   mismatch was found.
+
+   Each thread owns one CPU and one small RAM for the whole run. The
+   RAM is put back into the state a case needs with one page write,
+   rather than being created and filled again each time.
+
+   Encodings whose result the MIPS-I spec leaves undefined are never
+   generated: division by zero, the overflowing signed division,
+   JALR with rd==rs, and linking branches on $31.
+*/
+#include "mips.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string.h>
+
+// Layout of the RAM used by each case
+#define FUZZ_RAM_SIZE   0x200u
+#define FUZZ_DATA_BASE  0x100u
+#define FUZZ_DATA_SIZE  0x100u
+
+// The instruction being tested always sits at this address
+#define FUZZ_TEST_PC    0x8u
+
+// Encodings used to get values in and out of HI and LO
+#define FUZZ_MTHI_1     0x00200011u     // mthi $1
+#define FUZZ_MTLO_2     0x00400013u     // mtlo $2
+#define FUZZ_MFHI_26    0x0000D010u     // mfhi $26
+#define FUZZ_MFLO_27    0x0000D812u     // mflo $27
+
+struct fuzz_case_t
+{
+    unsigned instruction;   // Index within mips_isa
+    uint32_t encoding;
+    uint32_t follower;      // Executed in the delay slot of branches and jumps
+    uint32_t regs[32];
+    uint32_t hi, lo;
+    uint8_t data[FUZZ_DATA_SIZE];
+};
+
+struct fuzz_outcome_t
+{
+    mips_error err;
+    unsigned steps;         // Instructions which completed
+    uint32_t pc;
+    uint32_t regs[32];
+    uint8_t mem[FUZZ_RAM_SIZE];
+};
+
+struct fuzz_rng_t
+{
+    uint64_t state;
+
+    uint32_t operator()()
+    {
+        // xorshift64*
+        state^=state>>12;
+        state^=state<<25;
+        state^=state>>27;
+        return (uint32_t)((state*0x2545F4914F6CDD1DULL)>>32);
+    }
+};
+
+static const mips_isa_info &fuzz_info(const fuzz_case_t &c)
+{
+    return *mips_isa_get(c.instruction);
+}
+
+static bool fuzz_uses_hilo(const fuzz_case_t &c)
+{
+    return (fuzz_info(c).flags & (mips_isa_ReadsHiLo | mips_isa_WritesHiLo))!=0;
+}
+
+static bool fuzz_is_control(const fuzz_case_t &c)
+{
+    return (fuzz_info(c).flags & (mips_isa_Branch | mips_isa_Jump))!=0;
+}
+
+/* Number of instructions executed from FUZZ_TEST_PC onwards. Branches
+   need their delay slot, and HI/LO can only be seen by reading them out. */
+static unsigned fuzz_step_count(const fuzz_case_t &c)
+{
+    if(fuzz_is_control(c)){
+        return 2;
+    }
+    return fuzz_uses_hilo(c) ? 3 : 1;
+}
+
+static void fuzz_put_word(uint8_t *mem, uint32_t address, uint32_t value)
+{
+    mem[address+0]=value>>24;
+    mem[address+1]=value>>16;
+    mem[address+2]=value>>8;
+    mem[address+3]=value;
+}
+
+static uint32_t fuzz_get_word(const uint8_t *mem, uint32_t address)
+{
+    return (mem[address]<<24) | (mem[address+1]<<16) | (mem[address+2]<<8) | mem[address+3];
+}
+
+/* Memory contents at the start of a case: an optional prelude to load
+   HI and LO, the instruction, what follows it, then the data. */
+static void fuzz_build_image(const fuzz_case_t &c, uint8_t *mem)
+{
+    memset(mem, 0, FUZZ_RAM_SIZE);
+    fuzz_put_word(mem, 0x0, FUZZ_MTHI_1);
+    fuzz_put_word(mem, 0x4, FUZZ_MTLO_2);
+    fuzz_put_word(mem, FUZZ_TEST_PC, c.encoding);
+    if(fuzz_is_control(c)){
+        fuzz_put_word(mem, FUZZ_TEST_PC+4, c.follower);
+    }else{
+        fuzz_put_word(mem, FUZZ_TEST_PC+4, FUZZ_MFHI_26);
+        fuzz_put_word(mem, FUZZ_TEST_PC+8, FUZZ_MFLO_27);
+    }
+    memcpy(mem+FUZZ_DATA_BASE, c.data, FUZZ_DATA_SIZE);
+}
+
+static bool fuzz_same(const fuzz_outcome_t &a, const fuzz_outcome_t &b)
+{
+    return a.err==b.err && a.steps==b.steps && a.pc==b.pc
+        && !memcmp(a.regs, b.regs, sizeof(a.regs))
+        && !memcmp(a.mem, b.mem, sizeof(a.mem));
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Reference model
+//
+// Written for clarity rather than speed. Memory accesses are checked
+// in the same order as mips_mem_ram.cpp, so the errors should match.
+
+struct ref_cpu_t
+{
+    uint32_t regs[32];
+    uint32_t pc, npc;
+    uint32_t hi, lo;
+    uint8_t mem[FUZZ_RAM_SIZE];
+};
+
+static mips_error ref_check(uint32_t address, uint32_t length)
+{
+    if(address % length){
+        return mips_ExceptionInvalidAlignment;
+    }
+    if(address+length > FUZZ_RAM_SIZE || address > UINT32_MAX-length){
+        return mips_ExceptionInvalidAddress;
+    }
+    return mips_Success;
+}
+
+static mips_error ref_load(const ref_cpu_t &r, uint32_t address, uint32_t length, uint32_t *value)
+{
+    mips_error err=ref_check(address, length);
+    if(err){
+        return err;
+    }
+    uint32_t v=0;
+    for(unsigned i=0; i<length; i++){
+        v=(v<<8) | r.mem[address+i];
+    }
+    *value=v;
+    return mips_Success;
+}
+
+static mips_error ref_store(ref_cpu_t &r, uint32_t address, uint32_t length, uint32_t value)
+{
+    mips_error err=ref_check(address, length);
+    if(err){
+        return err;
+    }
+    for(unsigned i=0; i<length; i++){
+        r.mem[address+i]=value>>(8*(length-1-i));
+    }
+    return mips_Success;
+}
+
+static uint32_t ref_sext16(uint32_t x)
+{
+    return (uint32_t)(int32_t)(int16_t)x;
+}
+
+static mips_error ref_step(ref_cpu_t &r)
+{
+    uint32_t instr;
+    mips_error err=ref_load(r, r.pc, 4, &instr);
+    if(err){
+        return err;
+    }
+
+    uint32_t opcode=instr>>26;
+    uint32_t rs=(instr>>21)&0x1F, rt=(instr>>16)&0x1F, rd=(instr>>11)&0x1F;
+    uint32_t shamt=(instr>>6)&0x1F, funct=instr&0x3F;
+    uint32_t imm=instr&0xFFFF, simm=ref_sext16(imm);
+    uint32_t a=r.regs[rs], b=r.regs[rt];
+
+    // Results are only committed once we know there is no exception
+    uint32_t next=r.npc+4;
+    int dst=-1;
+    uint32_t value=0;
+    uint32_t hi=r.hi, lo=r.lo;
+    uint32_t branchTarget=r.npc+(simm<<2);
+
+    switch(opcode){
+    case 0x00:
+        switch(funct){
+        case 0x00:  dst=rd; value=b<<shamt;  break;
+        case 0x02:  dst=rd; value=b>>shamt;  break;
+        case 0x03:  dst=rd; value=(uint32_t)((int32_t)b>>shamt);    break;
+        case 0x04:  dst=rd; value=b<<(a&0x1F);  break;
+        case 0x06:  dst=rd; value=b>>(a&0x1F);  break;
+        case 0x07:  dst=rd; value=(uint32_t)((int32_t)b>>(a&0x1F)); break;
+        case 0x08:  next=a; break;
+        case 0x09:  dst=rd; value=r.pc+8; next=a;   break;
+        case 0x10:  dst=rd; value=r.hi; break;
+        case 0x11:  hi=a;   break;
+        case 0x12:  dst=rd; value=r.lo; break;
+        case 0x13:  lo=a;   break;
+        case 0x18:{
+            int64_t p=(int64_t)(int32_t)a * (int64_t)(int32_t)b;
+            hi=(uint32_t)((uint64_t)p>>32);
+            lo=(uint32_t)p;
+            break;
+        }
+        case 0x19:{
+            uint64_t p=(uint64_t)a * (uint64_t)b;
+            hi=(uint32_t)(p>>32);
+            lo=(uint32_t)p;
+            break;
+        }
+        case 0x1A:  lo=(uint32_t)((int32_t)a/(int32_t)b);   hi=(uint32_t)((int32_t)a%(int32_t)b);   break;
+        case 0x1B:  lo=a/b; hi=a%b; break;
+        case 0x20:
+        case 0x22:{
+            uint32_t y = funct==0x20 ? b : (uint32_t)(0-b);
+            int64_t wide = funct==0x20 ? (int64_t)(int32_t)a+(int32_t)b : (int64_t)(int32_t)a-(int32_t)b;
+            if(wide!=(int32_t)(a+y)){
+                return mips_ExceptionArithmeticOverflow;
+            }
+            dst=rd; value=a+y;
+            break;
+        }
+        case 0x21:  dst=rd; value=a+b;  break;
+        case 0x23:  dst=rd; value=a-b;  break;
+        case 0x24:  dst=rd; value=a&b;  break;
+        case 0x25:  dst=rd; value=a|b;  break;
+        case 0x26:  dst=rd; value=a^b;  break;
+        case 0x2A:  dst=rd; value=(int32_t)a<(int32_t)b;    break;
+        case 0x2B:  dst=rd; value=a<b;  break;
+        default:
+            return mips_ExceptionInvalidInstruction;
+        }
+        break;
+    case 0x01:{
+        bool taken;
+        switch(rt){
+        case 0x00:  taken=(int32_t)a<0;     break;
+        case 0x01:  taken=(int32_t)a>=0;    break;
+        case 0x10:  taken=(int32_t)a<0;     dst=31; value=r.pc+8;   break;
+        case 0x11:  taken=(int32_t)a>=0;    dst=31; value=r.pc+8;   break;
+        default:
+            return mips_ExceptionInvalidInstruction;
+        }
+        if(taken){
+            next=branchTarget;
+        }
+        break;
+    }
+    case 0x02:  next=(r.npc&0xF0000000) | ((instr&0x03FFFFFF)<<2);  break;
+    case 0x03:  next=(r.npc&0xF0000000) | ((instr&0x03FFFFFF)<<2);  dst=31; value=r.pc+8;   break;
+    case 0x04:  if(a==b) next=branchTarget; break;
+    case 0x05:  if(a!=b) next=branchTarget; break;
+    case 0x06:  if((int32_t)a<=0) next=branchTarget;    break;
+    case 0x07:  if((int32_t)a>0) next=branchTarget;     break;
+    case 0x08:{
+        int64_t wide=(int64_t)(int32_t)a+(int32_t)simm;
+        if(wide!=(int32_t)(a+simm)){
+            return mips_ExceptionArithmeticOverflow;
+        }
+        dst=rt; value=a+simm;
+        break;
+    }
+    case 0x09:  dst=rt; value=a+simm;   break;
+    case 0x0A:  dst=rt; value=(int32_t)a<(int32_t)simm; break;
+    case 0x0B:  dst=rt; value=a<simm;   break;
+    case 0x0C:  dst=rt; value=a&imm;    break;
+    case 0x0D:  dst=rt; value=a|imm;    break;
+    case 0x0E:  dst=rt; value=a^imm;    break;
+    case 0x0F:  dst=rt; value=imm<<16;  break;
+    case 0x20:
+    case 0x24:
+    case 0x21:
+    case 0x25:
+    case 0x23:{
+        uint32_t length = (opcode&3)==0 ? 1 : (opcode&3)==1 ? 2 : 4;
+        uint32_t v;
+        err=ref_load(r, a+simm, length, &v);
+        if(err){
+            return err;
+        }
+        if(opcode==0x20){
+            v=(uint32_t)(int32_t)(int8_t)v;
+        }else if(opcode==0x21){
+            v=ref_sext16(v);
+        }
+        dst=rt; value=v;
+        break;
+    }
+    case 0x22:
+    case 0x26:{
+        uint32_t address=a+simm;
+        uint32_t w;
+        err=ref_load(r, address&~3u, 4, &w);
+        if(err){
+            return err;
+        }
+        unsigned k=address&3;
+        if(opcode==0x22){   // LWL: the addressed byte becomes the most significant
+            value = k==0 ? w : (w<<(8*k)) | (b & ((1u<<(8*k))-1));
+        }else{              // LWR: the addressed byte becomes the least significant
+            value = k==3 ? w : (w>>(8*(3-k))) | (b & ~(0xFFFFFFFFu>>(8*(3-k))));
+        }
+        dst=rt;
+        break;
+    }
+    case 0x28:  err=ref_store(r, a+simm, 1, b); break;
+    case 0x29:  err=ref_store(r, a+simm, 2, b); break;
+    case 0x2B:  err=ref_store(r, a+simm, 4, b); break;
+    default:
+        return mips_ExceptionInvalidInstruction;
+    }
+    if(err){
+        return err;
+    }
+
+    if(dst>0){
+        r.regs[dst]=value;
+    }
+    r.hi=hi;
+    r.lo=lo;
+    r.pc=r.npc;
+    r.npc=next;
+    return mips_Success;
+}
+
+static void ref_run(const fuzz_case_t &c, fuzz_outcome_t &out)
+{
+    ref_cpu_t r;
+    memcpy(r.regs, c.regs, sizeof(r.regs));
+    r.regs[0]=0;
+    r.hi=c.hi;
+    r.lo=c.lo;
+    r.pc=FUZZ_TEST_PC;
+    r.npc=FUZZ_TEST_PC+4;
+    fuzz_build_image(c, r.mem);
+
+    out.err=mips_Success;
+    out.steps=0;
+    unsigned count=fuzz_step_count(c);
+    while(out.steps<count){
+        out.err=ref_step(r);
+        if(out.err){
+            break;
+        }
+        out.steps++;
+    }
+    out.pc=r.pc;
+    memcpy(out.regs, r.regs, sizeof(out.regs));
+    memcpy(out.mem, r.mem, sizeof(out.mem));
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// The CPU being tested
+
+struct fuzz_dut_t
+{
+    mips_mem_h mem;
+    mips_cpu_h cpu;
+};
+
+static void dut_run(fuzz_dut_t &dut, const fuzz_case_t &c, fuzz_outcome_t &out)
+{
+    uint8_t image[FUZZ_RAM_SIZE];
+    fuzz_build_image(c, image);
+    mips_mem_ram_write_page(dut.mem, 0, image);
+
+    mips_cpu_reset(dut.cpu);
+    if(fuzz_uses_hilo(c)){
+        // Only MTHI and MTLO can get a value into HI and LO
+        mips_cpu_set_register(dut.cpu, 1, c.hi);
+        mips_cpu_set_register(dut.cpu, 2, c.lo);
+        mips_cpu_set_pc(dut.cpu, 0);
+        mips_cpu_step(dut.cpu);
+        mips_cpu_step(dut.cpu);
+    }
+    for(unsigned i=1; i<32; i++){
+        mips_cpu_set_register(dut.cpu, i, c.regs[i]);
+    }
+    mips_cpu_set_pc(dut.cpu, FUZZ_TEST_PC);
+
+    out.err=mips_Success;
+    out.steps=0;
+    unsigned count=fuzz_step_count(c);
+    while(out.steps<count){
+        out.err=mips_cpu_step(dut.cpu);
+        if(out.err){
+            break;
+        }
+        out.steps++;
+    }
+    mips_cpu_get_pc(dut.cpu, &out.pc);
+    for(unsigned i=0; i<32; i++){
+        mips_cpu_get_register(dut.cpu, i, &out.regs[i]);
+    }
+    mips_mem_ram_read_page(dut.mem, 0, out.mem);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Generating and shrinking cases
+
+static uint32_t fuzz_value(fuzz_rng_t &rng)
+{
+    static const uint32_t interesting[]={
+        0, 1, 2, 0x7FFF, 0x8000, 0xFFFF, 0x10000, 0x7FFFFFFF, 0x80000000, 0x80000001, 0xFFFFFFFE, 0xFFFFFFFF
+    };
+    switch(rng()%4){
+    case 0:     return interesting[rng()%(sizeof(interesting)/sizeof(interesting[0]))];
+    case 1:     return (rng()%64)-32;
+    default:    return rng();
+    }
+}
+
+/* Whether the outcome of a case is defined by the spec. */
+static bool fuzz_valid(const fuzz_case_t &c)
+{
+    const mips_isa_info &info=fuzz_info(c);
+    uint32_t rs=(c.encoding>>21)&0x1F, rt=(c.encoding>>16)&0x1F, rd=(c.encoding>>11)&0x1F;
+    uint32_t a = rs ? c.regs[rs] : 0, b = rt ? c.regs[rt] : 0;
+
+    if(!strcmp(info.name, "DIV") || !strcmp(info.name, "DIVU")){
+        return b!=0 && !(info.name[3]==0 && a==0x80000000u && b==0xFFFFFFFFu);
+    }
+    if(!strcmp(info.name, "JALR")){
+        return rs!=rd;
+    }
+    if((info.flags & mips_isa_Branch) && (info.flags & mips_isa_Link)){
+        return rs!=31;
+    }
+    return true;
+}
+
+static void fuzz_generate(fuzz_rng_t &rng, const std::vector<unsigned> &chosen, const std::vector<unsigned> &followers, fuzz_case_t &c)
+{
+    do{
+        c.instruction=chosen[rng()%chosen.size()];
+        const mips_isa_info &info=fuzz_info(c);
+        c.encoding=info.match | (rng() & info.operands);
+
+        const mips_isa_info &f=*mips_isa_get(followers[rng()%followers.size()]);
+        c.follower=f.match | (rng() & f.operands);
+
+        c.regs[0]=0;
+        for(unsigned i=1; i<32; i++){
+            c.regs[i]=fuzz_value(rng);
+        }
+        c.hi=fuzz_value(rng);
+        c.lo=fuzz_value(rng);
+        for(unsigned i=0; i<FUZZ_DATA_SIZE; i+=4){
+            uint32_t v=rng();
+            memcpy(c.data+i, &v, 4);
+        }
+
+        // Most memory accesses should land in the data area, or they would just be address errors
+        uint32_t rs=(c.encoding>>21)&0x1F;
+        if((info.flags & (mips_isa_Load | mips_isa_Store)) && rs!=0 && rng()%8!=0){
+            c.regs[rs]=FUZZ_DATA_BASE + rng()%FUZZ_DATA_SIZE - ref_sext16(c.encoding&0xFFFF);
+        }
+    }while(!fuzz_valid(c));
+}
+
+static bool fuzz_fails(fuzz_dut_t &dut, const fuzz_case_t &c)
+{
+    fuzz_outcome_t want, got;
+    ref_run(c, want);
+    dut_run(dut, c, got);
+    return !fuzz_same(want, got);
+}
+
+/* Tries to make each part of a failing case simpler, keeping the
+   change whenever the case still fails. */
+static void fuzz_shrink(fuzz_dut_t &dut, fuzz_case_t &c)
+{
+    fuzz_case_t t;
+
+    t=c;
+    memset(t.data, 0, sizeof(t.data));
+    if(fuzz_fails(dut, t)){
+        c=t;
+    }
+
+    t=c;
+    t.follower=0;   // sll $0,$0,0 is a nop
+    if(fuzz_fails(dut, t)){
+        c=t;
+    }
+
+    for(unsigned i=1; i<32; i++){
+        static const uint32_t simpler[]={0, 1};
+        for(unsigned j=0; j<2 && c.regs[i]!=simpler[j]; j++){
+            t=c;
+            t.regs[i]=simpler[j];
+            if(fuzz_valid(t) && fuzz_fails(dut, t)){
+                c=t;
+                break;
+            }
+        }
+    }
+
+    t=c;
+    t.hi=0;
+    t.lo=0;
+    if(fuzz_fails(dut, t)){
+        c=t;
+    }
+}
+
+static void fuzz_report(fuzz_dut_t &dut, const fuzz_case_t &c)
+{
+    fuzz_outcome_t want, got;
+    ref_run(c, want);
+    dut_run(dut, c, got);
+
+    fprintf(stderr, "\nMismatch for %s: encoding=0x%08x", fuzz_info(c).name, c.encoding);
+    if(fuzz_is_control(c)){
+        fprintf(stderr, ", delay slot=0x%08x", c.follower);
+    }
+    fprintf(stderr, "\n  Initial state (registers not listed are zero):\n");
+    for(unsigned i=1; i<32; i++){
+        if(c.regs[i]){
+            fprintf(stderr, "    $%-2u = 0x%08x\n", i, c.regs[i]);
+        }
+    }
+    if(fuzz_uses_hilo(c)){
+        fprintf(stderr, "    HI = 0x%08x, LO = 0x%08x\n", c.hi, c.lo);
+    }
+    for(unsigned i=0; i<FUZZ_DATA_SIZE; i+=4){
+        uint32_t w=fuzz_get_word(c.data, i);
+        if(w){
+            fprintf(stderr, "    mem[0x%03x] = 0x%08x\n", FUZZ_DATA_BASE+i, w);
+        }
+    }
+
+    fprintf(stderr, "  Differences (expected / got):\n");
+    if(want.err!=got.err || want.steps!=got.steps){
+        fprintf(stderr, "    error 0x%x after %u steps / error 0x%x after %u steps\n", want.err, want.steps, got.err, got.steps);
+    }
+    if(want.pc!=got.pc){
+        fprintf(stderr, "    pc = 0x%08x / 0x%08x\n", want.pc, got.pc);
+    }
+    for(unsigned i=0; i<32; i++){
+        if(want.regs[i]!=got.regs[i]){
+            fprintf(stderr, "    $%-2u = 0x%08x / 0x%08x\n", i, want.regs[i], got.regs[i]);
+        }
+    }
+    for(unsigned i=0; i<FUZZ_RAM_SIZE; i+=4){
+        uint32_t w=fuzz_get_word(want.mem, i), g=fuzz_get_word(got.mem, i);
+        if(w!=g){
+            fprintf(stderr, "    mem[0x%03x] = 0x%08x / 0x%08x\n", i, w, g);
+        }
+    }
+    if(fuzz_uses_hilo(c) && !fuzz_is_control(c)){
+        fprintf(stderr, "  ($26 and $27 receive HI and LO via MFHI/MFLO after the instruction.)\n");
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////
+
+struct fuzz_shared_t
+{
+    std::vector<unsigned> chosen;
+    std::vector<unsigned> followers;
+    uint64_t seed;
+    uint64_t limit;
+    std::chrono::steady_clock::time_point deadline;
+    bool useDeadline;
+
+    std::atomic<uint64_t> issued;
+    std::vector<std::atomic<uint64_t> > cases;      // Indexed by instruction
+    std::vector<std::atomic<uint64_t> > mismatches;
+    std::mutex reportMutex;
+
+    fuzz_shared_t() : cases(mips_isa_count()), mismatches(mips_isa_count()) {}
+};
+
+static void fuzz_worker(fuzz_shared_t &shared, unsigned index)
+{
+    fuzz_dut_t dut;
+    dut.mem=mips_mem_create_ram(FUZZ_RAM_SIZE);
+    dut.cpu=mips_cpu_create(dut.mem);
+    if(!dut.cpu){
+        fprintf(stderr, "Couldn't create CPU.\n");
+        exit(1);
+    }
+
+    fuzz_rng_t rng;
+    rng.state=shared.seed*0x9E3779B97F4A7C15ULL + index + 1;
+
+    std::vector<uint64_t> cases(mips_isa_count(), 0), mismatches(mips_isa_count(), 0);
+
+    // Work is taken in chunks, so that the shared counter isn't touched on every case
+    const uint64_t chunk=1024;
+    while(true){
+        uint64_t begin=shared.issued.fetch_add(chunk);
+        if(begin>=shared.limit){
+            break;
+        }
+        if(shared.useDeadline && std::chrono::steady_clock::now()>shared.deadline){
+            break;
+        }
+        uint64_t end=std::min(begin+chunk, shared.limit);
+
+        for(uint64_t i=begin; i<end; i++){
+            fuzz_case_t c;
+            fuzz_generate(rng, shared.chosen, shared.followers, c);
+            cases[c.instruction]++;
+
+            if(fuzz_fails(dut, c)){
+                // Only the first failure of each instruction is worth shrinking and printing
+                if(mismatches[c.instruction]++==0 && shared.mismatches[c.instruction].fetch_add(1)==0){
+                    fuzz_shrink(dut, c);
+                    std::lock_guard<std::mutex> lock(shared.reportMutex);
+                    fuzz_report(dut, c);
+                }
+            }
+        }
+    }
+
+    for(unsigned i=0; i<cases.size(); i++){
+        shared.cases[i]+=cases[i];
+        // The first one was already counted when it was reported
+        if(mismatches[i]>1){
+            shared.mismatches[i]+=mismatches[i]-1;
+        }
+    }
+
+    mips_cpu_free(dut.cpu);
+    mips_mem_free(dut.mem);
+}
+
+static void fuzz_usage()
+{
+    fprintf(stderr, "Usage: mips_fuzz [-n cases] [-d seconds] [-j threads] [-s seed] [INSTR ...]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    fuzz_shared_t shared;
+    shared.seed=1;
+    shared.limit=1000000;
+    shared.useDeadline=false;
+    shared.issued=0;
+    unsigned threads=std::thread::hardware_concurrency();
+    double seconds=0;
+
+    for(int i=1; i<argc; i++){
+        std::string arg=argv[i];
+        if(arg[0]=='-'){
+            if(i+1>=argc){
+                fuzz_usage();
+            }
+            const char *value=argv[++i];
+            if(arg=="-n"){
+                shared.limit=strtoull(value, 0, 0);
+            }else if(arg=="-d"){
+                seconds=strtod(value, 0);
+            }else if(arg=="-j"){
+                threads=strtoul(value, 0, 0);
+            }else if(arg=="-s"){
+                shared.seed=strtoull(value, 0, 0);
+            }else{
+                fuzz_usage();
+            }
+        }else{
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+            unsigned j=0;
+            while(j<mips_isa_count() && arg!=mips_isa_get(j)->name){
+                j++;
+            }
+            if(j==mips_isa_count()){
+                fprintf(stderr, "Unknown instruction '%s'.\n", argv[i]);
+                exit(1);
+            }
+            shared.chosen.push_back(j);
+        }
+    }
+
+    bool all=shared.chosen.empty();
+    for(unsigned i=0; i<mips_isa_count(); i++){
+        const mips_isa_info &info=*mips_isa_get(i);
+        if(all){
+            shared.chosen.push_back(i);
+        }
+        // Delay slots are filled with simple instructions that can't fail
+        if(!(info.flags & (mips_isa_Branch | mips_isa_Jump | mips_isa_Load | mips_isa_Store | mips_isa_Overflow | mips_isa_ReadsHiLo | mips_isa_WritesHiLo))){
+            shared.followers.push_back(i);
+        }
+    }
+
+    if(seconds>0){
+        shared.useDeadline=true;
+        shared.deadline=std::chrono::steady_clock::now()+std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+        if(shared.limit==0){
+            shared.limit=UINT64_MAX;
+        }
+    }
+    threads=std::max(1u, threads);
+
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for(unsigned i=0; i<threads; i++){
+        pool.push_back(std::thread(fuzz_worker, std::ref(shared), i));
+    }
+    for(unsigned i=0; i<threads; i++){
+        pool[i].join();
+    }
+    double elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    uint64_t total=0, failed=0;
+    fprintf(stderr, "\n| Instruction |      cases | mismatches |\n");
+    fprintf(stderr, "+-------------+------------+------------+\n");
+    for(unsigned i=0; i<mips_isa_count(); i++){
+        if(shared.cases[i]==0){
+            continue;
+        }
+        fprintf(stderr, "|%12s | %10llu | %10llu |\n", mips_isa_get(i)->name, (unsigned long long)shared.cases[i], (unsigned long long)shared.mismatches[i]);
+        total+=shared.cases[i];
+        failed+=shared.mismatches[i];
+    }
+    fprintf(stderr, "+-------------+------------+------------+\n");
+    fprintf(stderr, "\n%llu cases, %llu mismatches, %.3f seconds on %u threads (%.0f cases/sec).\n",
+        (unsigned long long)total, (unsigned long long)failed, elapsed, threads, total/elapsed);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,665 @@
+/* Runs a binary image on a CPU, as a function call or a batch of them.
+
+   This does what fragments/run_fibonacci and fragments/run_addu do, but
+   with everything they hard-code given on the command line:
+
+       tools/mips_run [options] image.bin
+
+       -a address      Load address of the image (default 0)
+       -m bytes        RAM size (default 0x20000)
+       -e pc           Entry point (default the load address)
+       -r reg=value    Initial register value, can be repeated. Registers
+                       can be given as a number, $number, or by their
+                       conventional name (a0, sp, ra, ...)
+       -s pc           Sentinel return address, put in $31 before each
+                       run; reaching it ends the run (default 0x10000000)
+       -l steps        Maximum instructions per run (default 100000000)
+       -p reg          Register to print after a run (default v0), can be repeated
+       -b file         Batch file of runs, see below
+       -v              Print every batch row, not just failures
+       -c file         Record instruction coverage, merged into the
+                       given file, and print a coverage report
+       -n cores        Run the image on this many cores at once, sharing
+                       the RAM (default 1), see below
+       -q steps        Instructions each core runs before waiting for the
+                       others, or 0 to let them run freely (default 1000)
+       -x library      Run the image using code translated ahead of time
+                       by tools/mips_aot (see mips_aot.h), rather than by
+                       stepping the CPU
+       -X dir          As for -x, but using the library for this image from
+                       the given cache directory, which is translated and
+                       compiled first if the image hasn't been seen before.
+                       The compiler can be set with MIPS_AOT_CXX
+       -k name=pc[,steps[,rate]]
+                       Run the function at pc natively instead of stepping
+                       it, counting each call as the given number of
+                       instructions (default 1), can be repeated. The
+                       functions are memcpy, memset, and fibonacci (the
+                       same as f_fibonacci). For memcpy and memset, rate
+                       instructions (default 0) are also counted for each
+                       word written
+
+   The stack pointer starts at the top of RAM unless set with -r. For
+   example, this is run_fibonacci:
+
+       tools/mips_run -r a0=12 fragments/f_fibonacci-mips.bin
+
+   A batch file has one run per line. Each line sets registers, then
+   after "=>" gives the values expected in registers at the end:
+
+       # n => fib(n)
+       a0=12 => v0=144
+       a0=20 => v0=6765
+
+   Every row starts from the same state: the registers from -r, and
+   RAM as it was just after the image was loaded. Only the pages a run
+   wrote to are restored between rows, so short runs stay cheap even
+   with a large RAM. No output is produced while a run is stepping.
+
+   The program can print through the console at MIPS_CONSOLE_ADDRESS,
+   which is written to stdout at the end of each run (or whenever 4KB
+   have built up), and read the number of instructions it has run so far
+   from the timer at MIPS_TIMER_ADDRESS, which starts from zero for each
+   run. See mips_devices.h.
+
+   With more than one core, every core starts at the entry point with
+   the same registers, except that each core's stack is RUN_CORE_STACK
+   bytes below the previous one. A core can find its number (from 0)
+   by reading MIPS_SMP_CORE_ID_ADDRESS, and stops when it returns to
+   the sentinel. The registers are printed for each core. The cores
+   share the console, but there is no timer. This can't be combined
+   with -b or -c.
+
+   With -x or -X, the library must have been translated from the same image at
+   the same address. There is no timer, as the instruction count is only
+   known once a run has finished, and it can't be combined with -c or -n.
+
+   With -k, hooked calls return to $ra straight away, having done their
+   work through mips_hle.h. For example, this spends all its time in
+   f_fibonacci, so hooking the entry point reduces it to a single call:
+
+       tools/mips_run -k fibonacci=0,1000 -r a0=30 fragments/f_fibonacci-mips.bin
+
+   This can't be combined with -c, -n, -x or -X.
+*/
+#include "mips.h"
+
+#include "../fragments/f_fibonacci.c"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <string.h>
+#include <ctype.h>
+
+// Bytes of stack for each core, when running on more than one
+#define RUN_CORE_STACK 0x4000
+
+struct run_assign_t
+{
+    unsigned index;
+    uint32_t value;
+};
+
+struct run_row_t
+{
+    unsigned line;
+    std::vector<run_assign_t> inputs;
+    std::vector<run_assign_t> expected;
+};
+
+static const char *sg_regNames[32]={
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+static uint32_t run_parse_number(const std::string &text, const char *what)
+{
+    char *end;
+    long long v=strtoll(text.c_str(), &end, 0);
+    if(text.empty() || *end){
+        fprintf(stderr, "Error: '%s' is not a valid %s.\n", text.c_str(), what);
+        exit(1);
+    }
+    return (uint32_t)v;
+}
+
+/* As run_parse_number, but for counts that can go past 32 bits. */
+static uint64_t run_parse_count(const std::string &text, const char *what)
+{
+    char *end;
+    unsigned long long v=strtoull(text.c_str(), &end, 0);
+    if(text.empty() || text[0]=='-' || *end){
+        fprintf(stderr, "Error: '%s' is not a valid %s.\n", text.c_str(), what);
+        exit(1);
+    }
+    return v;
+}
+
+static unsigned run_parse_register(std::string text)
+{
+    if(!text.empty() && text[0]=='$'){
+        text=text.substr(1);
+    }
+    for(unsigned i=0; i<32; i++){
+        if(text==sg_regNames[i]){
+            return i;
+        }
+    }
+    if(!text.empty() && isdigit((unsigned char)text[0])){
+        unsigned index=run_parse_number(text, "register");
+        if(index<32){
+            return index;
+        }
+    }
+    fprintf(stderr, "Error: '%s' is not a register.\n", text.c_str());
+    exit(1);
+}
+
+static run_assign_t run_parse_assign(const std::string &text)
+{
+    size_t eq=text.find('=');
+    if(eq==std::string::npos){
+        fprintf(stderr, "Error: expected reg=value, got '%s'.\n", text.c_str());
+        exit(1);
+    }
+    run_assign_t a;
+    a.index=run_parse_register(text.substr(0, eq));
+    a.value=run_parse_number(text.substr(eq+1), "value");
+    return a;
+}
+
+static mips_error run_hle_fibonacci(void *param, mips_cpu_h cpu, mips_mem_h mem, uint64_t *steps)
+{
+    (void)param;
+    (void)steps;
+    uint32_t n;
+    mips_error err=mips_hle_get_arg(cpu, mem, 0, &n);
+    if(!err){
+        err=mips_hle_set_result(cpu, f_fibonacci(n), 0);
+    }
+    return err;
+}
+
+/* Adds a hook given as name=pc[,steps[,rate]]. The rates are kept in
+   a deque, so the hooks can point at them while more are added. */
+static void run_parse_hook(mips_hle_h hle, std::deque<uint32_t> &rates, const std::string &text)
+{
+    size_t eq=text.find('=');
+    if(eq==std::string::npos){
+        fprintf(stderr, "Error: expected name=pc[,steps[,rate]], got '%s'.\n", text.c_str());
+        exit(1);
+    }
+    std::string name=text.substr(0, eq);
+    std::vector<std::string> fields;
+    for(size_t start=eq+1, comma; ; start=comma+1){
+        comma=text.find(',', start);
+        fields.push_back(text.substr(start, comma==std::string::npos ? std::string::npos : comma-start));
+        if(comma==std::string::npos){
+            break;
+        }
+    }
+    if(fields.size()>3){
+        fprintf(stderr, "Error: expected name=pc[,steps[,rate]], got '%s'.\n", text.c_str());
+        exit(1);
+    }
+    uint32_t address=run_parse_number(fields[0], "address");
+    uint64_t steps = fields.size()>1 ? run_parse_number(fields[1], "number of steps") : 1;
+    void *param=0;
+    if(fields.size()>2){
+        rates.push_back(run_parse_number(fields[2], "rate"));
+        param=&rates.back();
+    }
+
+    mips_hle_fn fn;
+    if(name=="memcpy"){
+        fn=mips_hle_memcpy;
+    }else if(name=="memset"){
+        fn=mips_hle_memset;
+    }else if(name=="fibonacci"){
+        fn=run_hle_fibonacci;
+    }else{
+        fprintf(stderr, "Error: there is no native function called '%s'.\n", name.c_str());
+        exit(1);
+    }
+    if(param && fn==run_hle_fibonacci){
+        fprintf(stderr, "Error: '%s' doesn't take a rate.\n", name.c_str());
+        exit(1);
+    }
+    if(mips_hle_add(hle, address, fn, param, steps)){
+        fprintf(stderr, "Error: can't hook the unaligned address 0x%x.\n", address);
+        exit(1);
+    }
+}
+
+static void run_load_batch(const char *path, std::vector<run_row_t> &rows)
+{
+    FILE *src=fopen(path, "rt");
+    if(!src){
+        fprintf(stderr, "Error: couldn't open batch file '%s'.\n", path);
+        exit(1);
+    }
+    char buffer[4096];
+    unsigned line=0;
+    while(fgets(buffer, sizeof(buffer), src)){
+        line++;
+        char *hash=strchr(buffer, '#');
+        if(hash){
+            *hash=0;
+        }
+
+        run_row_t row;
+        row.line=line;
+        bool afterArrow=false, any=false;
+        for(char *tok=strtok(buffer, " \t\r\n"); tok; tok=strtok(0, " \t\r\n")){
+            any=true;
+            if(!strcmp(tok, "=>")){
+                afterArrow=true;
+            }else if(afterArrow){
+                row.expected.push_back(run_parse_assign(tok));
+            }else{
+                row.inputs.push_back(run_parse_assign(tok));
+            }
+        }
+        if(any){
+            rows.push_back(row);
+        }
+    }
+    fclose(src);
+}
+
+struct run_outcome_t
+{
+    mips_error err;
+    bool limited;       // Hit the step limit before the sentinel
+    uint64_t steps;
+};
+
+static run_outcome_t run_one(mips_cpu_h cpu, mips_mem_h mem, mips_coverage_h cov, mips_aot_h aot, mips_hle_h hle, uint32_t entry, uint32_t sentinel, uint64_t limit, uint64_t *retired)
+{
+    run_outcome_t res={mips_Success, false, 0};
+    *retired=0;
+    res.err=mips_cpu_set_pc(cpu, entry);
+    if(res.err){
+        return res;
+    }
+    uint32_t pc=entry;
+    if(aot){
+        res.err=mips_aot_run(aot, cpu, mem, sentinel, limit, &res.steps);
+        if(!res.err){
+            res.err=mips_cpu_get_pc(cpu, &pc);
+        }
+        res.limited = !res.err && pc!=sentinel;
+        return res;
+    }
+    while(pc!=sentinel){
+        if(res.steps>=limit){
+            res.limited=true;
+            break;
+        }
+        uint64_t n=1;
+        if(hle){
+            res.err=mips_hle_step(hle, cpu, mem, &n);
+        }else{
+            res.err = cov ? mips_coverage_step(cov, cpu, mem) : mips_cpu_step(cpu);
+        }
+        if(res.err){
+            break;
+        }
+        *retired = res.steps += n;
+        res.err=mips_cpu_get_pc(cpu, &pc);
+        if(res.err){
+            break;
+        }
+    }
+    return res;
+}
+
+static void run_print_registers(mips_cpu_h cpu, const std::vector<unsigned> &printed)
+{
+    for(unsigned i=0; i<printed.size(); i++){
+        uint32_t v;
+        if(mips_cpu_get_register(cpu, printed[i], &v)){
+            fprintf(stdout, ", %s = ?", sg_regNames[printed[i]]);
+        }else{
+            fprintf(stdout, ", %s = %u (0x%08x)", sg_regNames[printed[i]], v, v);
+        }
+    }
+    fprintf(stdout, "\n");
+}
+
+/* Runs the loaded image once on several cores, and prints how each
+   of them finished. */
+static int run_smp(mips_mem_h ram, mips_console_h con, unsigned cores, uint32_t quantum, uint32_t entry, uint32_t sentinel, uint64_t limit,
+    const std::vector<run_assign_t> &initial, const std::vector<unsigned> &printed)
+{
+    uint32_t ramSize=0;
+    mips_mem_ram_get_size(ram, &ramSize);
+    if(cores*RUN_CORE_STACK > ramSize){
+        fprintf(stderr, "Error: not enough RAM for a stack on each of %u cores.\n", cores);
+        exit(1);
+    }
+
+    std::vector<mips_mem_h> views(cores);
+    std::vector<mips_cpu_h> cpus(cores);
+    for(unsigned c=0; c<cores; c++){
+        views[c]=mips_mem_create_core_view(ram, c, MIPS_SMP_CORE_ID_ADDRESS);
+        cpus[c]=views[c] ? mips_cpu_create(views[c]) : 0;
+        if(!cpus[c]){
+            fprintf(stderr, "Error: couldn't create CPU.\n");
+            exit(1);
+        }
+        mips_cpu_set_pc(cpus[c], entry);
+        mips_cpu_set_register(cpus[c], 29, ramSize-c*RUN_CORE_STACK);
+        mips_cpu_set_register(cpus[c], 31, sentinel);
+        for(unsigned i=0; i<initial.size(); i++){
+            mips_cpu_set_register(cpus[c], initial[i].index, initial[i].value);
+        }
+    }
+
+    std::vector<mips_smp_result> results(cores);
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+    mips_smp_run(cores, &cpus[0], sentinel, limit, quantum, &results[0]);
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    mips_console_flush(con);
+
+    unsigned failed=0;
+    uint64_t totalSteps=0;
+    for(unsigned c=0; c<cores; c++){
+        totalSteps+=results[c].steps;
+        fprintf(stdout, "core %u: ", c);
+        if(results[c].err){
+            uint32_t pc;
+            if(mips_cpu_get_pc(cpus[c], &pc)){
+                fprintf(stdout, "error 0x%x", results[c].err);
+            }else{
+                fprintf(stdout, "error 0x%x at pc=0x%08x", results[c].err, pc);
+            }
+        }else if(!results[c].halted){
+            fprintf(stdout, "stopped before the sentinel");
+        }else{
+            fprintf(stdout, "ok");
+        }
+        failed += !results[c].halted;
+        fprintf(stdout, ", %llu steps", (unsigned long long)results[c].steps);
+        run_print_registers(cpus[c], printed);
+
+        mips_cpu_free(cpus[c]);
+        mips_mem_free(views[c]);
+    }
+    fprintf(stderr, "%u cores, %u failed, %llu instructions in %.3f seconds (%.1f MIPS).\n",
+        cores, failed, (unsigned long long)totalSteps, seconds, totalSteps/seconds/1e6);
+    return failed ? 1 : 0;
+}
+
+static void run_usage()
+{
+    fprintf(stderr, "Usage: mips_run [-a address] [-m bytes] [-e pc] [-r reg=value]... [-s pc] [-l steps] [-p reg]... [-b batch] [-v] [-c coverage] [-n cores] [-q steps] [-x library | -X cache] [-k name=pc[,steps[,rate]]]... image.bin\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t loadAddress=0, ramSize=0x20000, sentinel=0x10000000;
+    uint32_t entry=0;
+    bool entryGiven=false, verbose=false;
+    uint64_t limit=100000000;
+    unsigned cores=1;
+    uint32_t quantum=1000;
+    std::vector<run_assign_t> initial;
+    std::vector<unsigned> printed;
+    mips_hle_h hle=0;
+    std::deque<uint32_t> hookRates;
+    const char *imagePath=0, *batchPath=0, *coveragePath=0, *aotPath=0, *aotCache=0;
+
+    for(int i=1; i<argc; i++){
+        std::string arg=argv[i];
+        if(arg=="-v"){
+            verbose=true;
+            continue;
+        }
+        if(arg[0]!='-'){
+            if(imagePath){
+                run_usage();
+            }
+            imagePath=argv[i];
+            continue;
+        }
+        if(i+1>=argc){
+            run_usage();
+        }
+        std::string value=argv[++i];
+        if(arg=="-a"){
+            loadAddress=run_parse_number(value, "address");
+        }else if(arg=="-m"){
+            ramSize=run_parse_number(value, "RAM size");
+        }else if(arg=="-e"){
+            entry=run_parse_number(value, "address");
+            entryGiven=true;
+        }else if(arg=="-r"){
+            initial.push_back(run_parse_assign(value));
+        }else if(arg=="-s"){
+            sentinel=run_parse_number(value, "address");
+        }else if(arg=="-l"){
+            limit=run_parse_count(value, "step limit");
+        }else if(arg=="-p"){
+            printed.push_back(run_parse_register(value));
+        }else if(arg=="-b"){
+            batchPath=argv[i];
+        }else if(arg=="-c"){
+            coveragePath=argv[i];
+        }else if(arg=="-n"){
+            cores=run_parse_number(value, "number of cores");
+        }else if(arg=="-q"){
+            quantum=run_parse_number(value, "quantum");
+        }else if(arg=="-x"){
+            aotPath=argv[i];
+        }else if(arg=="-X"){
+            aotCache=argv[i];
+        }else if(arg=="-k"){
+            if(!hle){
+                hle=mips_hle_create();
+            }
+            run_parse_hook(hle, hookRates, value);
+        }else{
+            run_usage();
+        }
+    }
+    if(aotPath && aotCache){
+        run_usage();
+    }
+    if(aotCache){
+        aotPath=aotCache;   // The same restrictions apply
+    }
+    if(!imagePath || cores==0 || (cores>1 && (batchPath || coveragePath || aotPath)) || (aotPath && coveragePath) || (hle && (cores>1 || coveragePath || aotPath))){
+        run_usage();
+    }
+    if(!entryGiven){
+        entry=loadAddress;
+    }
+    if(printed.empty()){
+        printed.push_back(2);
+    }
+
+    mips_mem_h mem=mips_mem_create_ram(ramSize);
+    if(!mem){
+        fprintf(stderr, "Error: couldn't create a RAM of 0x%x bytes.\n", ramSize);
+        exit(1);
+    }
+    mips_cpu_h cpu=mips_cpu_create(mem);
+    if(!cpu){
+        fprintf(stderr, "Error: couldn't create CPU.\n");
+        exit(1);
+    }
+
+    uint64_t retired=0;
+    mips_console_h con=mips_console_create(stdout, 0, 0);
+    mips_timer_h timer=mips_timer_create(&retired);
+    mips_console_attach(con, mem, MIPS_CONSOLE_ADDRESS);
+    if(cores==1 && !aotPath){
+        mips_timer_attach(timer, mem, MIPS_TIMER_ADDRESS);
+    }
+
+    FILE *src=fopen(imagePath, "rb");
+    if(!src){
+        fprintf(stderr, "Error: cannot load image '%s'.\n", imagePath);
+        exit(1);
+    }
+    uint8_t bytes[4];
+    uint32_t offset=0;
+    size_t got;
+    while((got=fread(bytes, 1, 4, src))>0){
+        memset(bytes+got, 0, 4-got);
+        if(mips_mem_write(mem, loadAddress+offset, 4, bytes)){
+            fprintf(stderr, "Error: image doesn't fit in RAM at 0x%x.\n", loadAddress);
+            exit(1);
+        }
+        offset+=4;
+    }
+    fclose(src);
+
+    // Remember the loaded RAM, so each run can start from it
+    std::vector<uint8_t> snapshot(ramSize);
+    uint32_t pageCount=(ramSize+MIPS_MEM_RAM_PAGE_SIZE-1)/MIPS_MEM_RAM_PAGE_SIZE;
+    for(uint32_t p=0; p<pageCount; p++){
+        mips_mem_ram_read_page(mem, p, &snapshot[p*MIPS_MEM_RAM_PAGE_SIZE]);
+    }
+    mips_mem_ram_clear_dirty(mem);
+    std::vector<uint32_t> dirty(pageCount);
+
+    mips_aot_h aot=0;
+    if(aotCache){
+        aot=mips_aot_cache_load(aotCache, getenv("MIPS_AOT_CXX"), mem, loadAddress, offset);
+        if(!aot){
+            fprintf(stderr, "Error: couldn't translate the image into '%s'.\n", aotCache);
+            exit(1);
+        }
+    }else if(aotPath){
+        aot=mips_aot_open(aotPath);
+        if(!aot){
+            fprintf(stderr, "Error: cannot load translated library '%s'.\n", aotPath);
+            exit(1);
+        }
+        if(mips_aot_check(aot, mem)){
+            fprintf(stderr, "Error: '%s' was not translated from this image at this address.\n", aotPath);
+            exit(1);
+        }
+    }
+
+    mips_coverage_h cov=0;
+    if(coveragePath){
+        cov=mips_coverage_create(loadAddress, offset);
+        if(mips_coverage_load(cov, coveragePath)){
+            fprintf(stderr, "Error: '%s' is not coverage for an image of this size at this address.\n", coveragePath);
+            exit(1);
+        }
+    }
+
+    if(cores>1){
+        int res=run_smp(mem, con, cores, quantum, entry, sentinel, limit, initial, printed);
+        mips_cpu_free(cpu);
+        mips_mem_free(mem);
+        mips_console_free(con);
+        mips_timer_free(timer);
+        return res;
+    }
+
+    std::vector<run_row_t> rows;
+    if(batchPath){
+        run_load_batch(batchPath, rows);
+    }else{
+        rows.push_back(run_row_t());
+        rows.back().line=0;
+    }
+
+    unsigned failed=0;
+    uint64_t totalSteps=0;
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+
+    for(unsigned r=0; r<rows.size(); r++){
+        const run_row_t &row=rows[r];
+
+        if(r>0){
+            uint32_t count=0;
+            mips_mem_ram_get_dirty_pages(mem, pageCount, &dirty[0], &count);
+            for(uint32_t i=0; i<count; i++){
+                mips_mem_ram_write_page(mem, dirty[i], &snapshot[dirty[i]*MIPS_MEM_RAM_PAGE_SIZE]);
+            }
+            mips_mem_ram_clear_dirty(mem);
+        }
+
+        mips_cpu_reset(cpu);
+        mips_cpu_set_register(cpu, 29, ramSize);
+        mips_cpu_set_register(cpu, 31, sentinel);
+        for(unsigned i=0; i<initial.size(); i++){
+            mips_cpu_set_register(cpu, initial[i].index, initial[i].value);
+        }
+        for(unsigned i=0; i<row.inputs.size(); i++){
+            mips_cpu_set_register(cpu, row.inputs[i].index, row.inputs[i].value);
+        }
+
+        run_outcome_t out=run_one(cpu, mem, cov, aot, hle, entry, sentinel, limit, &retired);
+        totalSteps+=out.steps;
+        mips_console_flush(con);
+
+        std::string problem;
+        char text[128];
+        if(out.err){
+            uint32_t pc;
+            if(mips_cpu_get_pc(cpu, &pc)){
+                snprintf(text, sizeof(text), "error 0x%x", out.err);
+            }else{
+                snprintf(text, sizeof(text), "error 0x%x at pc=0x%08x", out.err, pc);
+            }
+            problem=text;
+        }else if(out.limited){
+            problem="step limit reached";
+        }
+        for(unsigned i=0; i<row.expected.size() && problem.empty(); i++){
+            uint32_t v;
+            if(mips_cpu_get_register(cpu, row.expected[i].index, &v)){
+                snprintf(text, sizeof(text), "couldn't read %s", sg_regNames[row.expected[i].index]);
+                problem=text;
+            }else if(v!=row.expected[i].value){
+                snprintf(text, sizeof(text), "%s = 0x%08x, expected 0x%08x", sg_regNames[row.expected[i].index], v, row.expected[i].value);
+                problem=text;
+            }
+        }
+
+        if(!problem.empty()){
+            failed++;
+        }
+        if(!problem.empty() || verbose || !batchPath){
+            if(batchPath){
+                fprintf(stdout, "line %u: ", row.line);
+            }
+            fprintf(stdout, "%s, %llu steps", problem.empty() ? "ok" : problem.c_str(), (unsigned long long)out.steps);
+            run_print_registers(cpu, printed);
+        }
+    }
+
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    fprintf(stderr, "%u runs, %u failed, %llu instructions in %.3f seconds (%.1f MIPS).\n",
+        (unsigned)rows.size(), failed, (unsigned long long)totalSteps, seconds, totalSteps/seconds/1e6);
+
+    if(cov){
+        if(mips_coverage_save(cov, coveragePath)){
+            fprintf(stderr, "Error: couldn't write coverage to '%s'.\n", coveragePath);
+            exit(1);
+        }
+        mips_coverage_report(cov, stderr);
+        mips_coverage_free(cov);
+    }
+
+    mips_cpu_free(cpu);
+    mips_mem_free(mem);
+    mips_console_free(con);
+    mips_timer_free(timer);
+    mips_aot_close(aot);
+    mips_hle_free(hle);
+
+    return failed ? 1 : 0;
+}